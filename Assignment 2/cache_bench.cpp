@@ -0,0 +1,212 @@
+/*
+ *  Throughput benchmark for the cache model. Drives the hierarchy in cache_model.h
+ *  with synthetic address streams, without Pin, and reports how many simulated
+ *  accesses per second the model sustains for each configuration, replacement
+ *  policy and access pattern.
+ */
+
+#include <cmath>
+#include <unistd.h>
+#include "cache_model.h"
+
+/*******************************************************************************************
+ * ACCESS STREAM GENERATORS
+ *
+ * Every generator fills a buffer of addresses up front so that only the simulation
+ * itself is timed. All of them are driven by the same seeded generator, so a given
+ * seed always produces the same streams.
+*******************************************************************************************/
+
+#define LINE 64
+#define WORD 8
+
+static unsigned long long rng_state;
+
+// xorshift64*, good enough for address streams and independent of the C library rand()
+// that the RR replacement policy uses
+unsigned long nextRandom() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned long)(rng_state * 2685821657736338717ULL);
+}
+
+// Base of the simulated data region, so that addresses look like heap addresses
+static const unsigned long base_addr = 0x7f0000000000UL;
+
+// Unit stride through the footprint, one word at a time
+void generateSequential(unsigned long *addrs, long n, unsigned long footprint) {
+    for (long i = 0; i < n; ++i)
+        addrs[i] = base_addr + (i * WORD) % footprint;
+}
+
+// Fixed stride of several lines, wrapping around the footprint
+void generateStrided(unsigned long *addrs, long n, unsigned long footprint) {
+    const unsigned long stride = 4*LINE + WORD;
+    for (long i = 0; i < n; ++i)
+        addrs[i] = base_addr + (i * stride) % footprint;
+}
+
+// Uniformly random words in the footprint
+void generateUniform(unsigned long *addrs, long n, unsigned long footprint) {
+    for (long i = 0; i < n; ++i)
+        addrs[i] = base_addr + (nextRandom() % (footprint / WORD)) * WORD;
+}
+
+// Zipfian (s = 0.99) popularity over the lines of the footprint. Popular lines are
+// scattered over the footprint rather than packed at its start.
+void generateZipfian(unsigned long *addrs, long n, unsigned long footprint) {
+    long line_count = footprint / LINE;
+    double *cdf = new double[line_count];
+    double sum = 0;
+    for (long r = 0; r < line_count; ++r) {
+        sum += 1.0 / pow((double)(r+1), 0.99);
+        cdf[r] = sum;
+    }
+    for (long i = 0; i < n; ++i) {
+        double u = (double)(nextRandom() >> 11) / (double)(1UL << 53) * sum;
+        long lo = 0, hi = line_count - 1;
+        while (lo < hi) {
+            long mid = (lo + hi) / 2;
+            if (cdf[mid] < u)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        // multiplying by an odd constant permutes the line numbers (line_count is a power of two)
+        unsigned long line = ((unsigned long)lo * 2654435761UL) & (line_count - 1);
+        addrs[i] = base_addr + line * LINE + (nextRandom() % (LINE / WORD)) * WORD;
+    }
+    delete[] cdf;
+}
+
+// Follows a single random cycle through all lines of the footprint, like walking a
+// shuffled linked list
+void generatePointerChase(unsigned long *addrs, long n, unsigned long footprint) {
+    long line_count = footprint / LINE;
+    long *next = new long[line_count];
+    long *order = new long[line_count];
+    for (long i = 0; i < line_count; ++i)
+        order[i] = i;
+    for (long i = line_count - 1; i > 0; --i) {
+        long j = nextRandom() % (i+1);
+        long t = order[i]; order[i] = order[j]; order[j] = t;
+    }
+    for (long i = 0; i < line_count; ++i)
+        next[order[i]] = order[(i+1) % line_count];
+    long line = order[0];
+    for (long i = 0; i < n; ++i) {
+        addrs[i] = base_addr + line * LINE;
+        line = next[line];
+    }
+    delete[] next;
+    delete[] order;
+}
+
+// Cycles through reuse_distance distinct lines in a fixed order, so every access
+// after the first pass has exactly that many distinct lines since its previous use
+static long reuse_distance = 1024;
+
+void generateReuse(unsigned long *addrs, long n, unsigned long footprint) {
+    for (long i = 0; i < n; ++i)
+        addrs[i] = base_addr + ((i % reuse_distance) * LINE) % footprint;
+}
+
+struct Pattern {
+    const char *name;
+    void (*generate)(unsigned long *, long, unsigned long);
+};
+
+static Pattern patterns[] = {
+    { "sequential", generateSequential },
+    { "strided", generateStrided },
+    { "uniform", generateUniform },
+    { "zipfian", generateZipfian },
+    { "pointer-chase", generatePointerChase },
+    { "reuse", generateReuse },
+};
+static const int pattern_count = sizeof(patterns) / sizeof(patterns[0]);
+
+/*******************************************************************************************
+ * BENCHMARK DRIVER
+*******************************************************************************************/
+
+double seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void usage(const char *prog) {
+    printf("USAGE:- %s [-n accesses] [-f footprint_KB] [-d reuse_distance] "
+            "[-w write_percent] [-s seed] [-p policy] <config_file>...\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    long access_count = 4*K*K;
+    unsigned long footprint = 16*K*K;
+    int write_percent = 0;
+    unsigned long long seed = 1;
+    const char *policies[] = { "LRU", "LFU", "RR" };
+    int policy_count = 3;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:f:d:w:s:p:")) != -1) {
+        switch (opt) {
+            case 'n': access_count = atol(optarg); break;
+            case 'f': footprint = atol(optarg) * K; break;
+            case 'd': reuse_distance = atol(optarg); break;
+            case 'w': write_percent = atoi(optarg); break;
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            case 'p': policies[0] = optarg; policy_count = 1; break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc || access_count <= 0 || (footprint & (footprint-1)) != 0) {
+        usage(argv[0]);
+        printf("The footprint must be a power of two.\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned long *addrs = new unsigned long[access_count];
+    bool *is_write = new bool[access_count];
+    CacheHierarchy hierarchy;
+
+    printf("%-24s %-6s %-14s %10s %9s %12s %9s\n",
+            "config", "policy", "pattern", "accesses", "seconds", "accesses/s", "L1 miss");
+    for (int c = optind; c < argc; ++c) {
+        const char *conf_name = strrchr(argv[c], '/') ? strrchr(argv[c], '/') + 1 : argv[c];
+        for (int p = 0; p < policy_count; ++p) {
+            for (int t = 0; t < pattern_count; ++t) {
+                // Same stream for every configuration and policy
+                rng_state = seed * 0x9E3779B97F4A7C15ULL + t + 1;
+                patterns[t].generate(addrs, access_count, footprint);
+                for (long i = 0; i < access_count; ++i)
+                    is_write[i] = (long)(nextRandom() % 100) < write_percent;
+
+                if (!hierarchy.readConfig(argv[c], policies[p])) {
+                    printf("Cannot read cache configuration %s\n", argv[c]);
+                    return EXIT_FAILURE;
+                }
+                double start = seconds();
+                for (long i = 0; i < access_count; ++i) {
+                    if (is_write[i])
+                        hierarchy.write(addrs[i], WORD);
+                    else
+                        hierarchy.read(addrs[i]);
+                }
+                hierarchy.flushWriteBuffers();
+                double elapsed = seconds() - start;
+
+                printf("%-24s %-6s %-14s %10ld %9.3f %12.0f %9.4f\n",
+                        conf_name, policies[p], patterns[t].name, access_count,
+                        elapsed, access_count / elapsed, hierarchy.level(0).missRate());
+                fflush(stdout);
+            }
+        }
+    }
+
+    delete[] addrs;
+    delete[] is_write;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1306 @@
+/*
+ *  Header-only cache hierarchy model. It has no dependency on Pin: the cache simulator
+ *  pintool, the throughput benchmark, the unit tests and the data caches of the
+ *  out-of-order simulator in Assignment 3 all drive the same model through a
+ *  CacheHierarchy object.
+ */
+
+#ifndef CACHE_MODEL_H
+#define CACHE_MODEL_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#define K 1024
+
+/*******************************************************************************************
+ * CACHE MODEL SECTION
+ *
+ * This section contains the declarations and defintions for the cache model
+*******************************************************************************************/
+
+/* Abstract class ReplacementPolicy */
+class ReplacementPolicy {
+    public:
+    virtual ~ReplacementPolicy() {}
+    virtual void updateCounters(int, int) {}
+    virtual int lineToReplace(int set_no) = 0;
+};
+
+/***********************************************************************************************
+ * LRUPolicy 
+ * **********************************************************************************************/
+
+/* Declarations */
+
+class LRUPolicy : public ReplacementPolicy {
+    int _set_count;
+    int _set_line_count;
+    int **_line_ctrs;
+
+    public:
+    LRUPolicy(int set_count, int set_line_count);
+    ~LRUPolicy();
+    void updateCounters(int set_no, int line_no);
+    int lineToReplace(int set_no);
+};
+
+/* Definitions */
+
+inline LRUPolicy::LRUPolicy(int set_count, int set_line_count) : _set_count(set_count), _set_line_count(set_line_count) {
+    _line_ctrs = new int*[_set_count];
+    for (int set_no = 0; set_no < _set_count; ++set_no) {
+        _line_ctrs[set_no] = new int[_set_line_count];
+        for (int line_no = 0; line_no < _set_line_count; ++line_no) {
+            _line_ctrs[set_no][line_no] = line_no;
+        }
+    }
+}
+
+inline LRUPolicy::~LRUPolicy() {
+    for (int set_no = 0; set_no < _set_count; ++set_no)
+        delete[] _line_ctrs[set_no]; 
+    delete[] _line_ctrs;
+}
+
+inline void LRUPolicy::updateCounters(int set_no, int line_no) {
+    for (int j = 0; j < _set_line_count; ++j) {
+        if ( _line_ctrs[set_no][j] < _line_ctrs[set_no][line_no] )
+            _line_ctrs[set_no][j]++;
+    }
+    _line_ctrs[set_no][line_no] = 0;
+}
+
+inline int LRUPolicy::lineToReplace(int set_no) {
+    for (int i = 0; i < _set_line_count; ++i) {
+        if ( _line_ctrs[set_no][i] == _set_line_count-1 )
+            return i;
+    }
+    return -1;
+}
+
+
+/***********************************************************************************************
+ * LFUPolicy 
+ * **********************************************************************************************/
+
+/* Declarations */
+
+class LFUPolicy : public ReplacementPolicy {
+    int _set_count;
+    int _set_line_count;
+    int **_line_ctrs;
+
+    public:
+    LFUPolicy(int set_count, int set_line_count);
+    ~LFUPolicy();
+    void updateCounters(int set_no, int line_no);
+    int lineToReplace(int set_no);
+};
+
+/* Definitions */
+
+inline LFUPolicy::LFUPolicy(int set_count, int set_line_count) : _set_count(set_count), _set_line_count(set_line_count) {
+    _line_ctrs = new int*[_set_count];
+    for (int set_no = 0; set_no < _set_count; ++set_no) {
+        _line_ctrs[set_no] = new int[_set_line_count];
+        for (int line_no = 0; line_no < _set_line_count; ++line_no) {
+            _line_ctrs[set_no][line_no] = 0;
+        }
+    }
+}
+
+inline LFUPolicy::~LFUPolicy() {
+    for (int set_no = 0; set_no < _set_count; ++set_no)
+        delete[] _line_ctrs[set_no]; 
+    delete[] _line_ctrs;
+}
+
+inline void LFUPolicy::updateCounters(int set_no, int line_no) {
+    _line_ctrs[set_no][line_no]++;
+}
+
+inline int LFUPolicy::lineToReplace(int set_no) {
+    int min_ctr = _line_ctrs[set_no][0];
+    int line_to_replace = 0;
+    for (int i = 1; i < _set_line_count; ++i) {
+        if ( _line_ctrs[set_no][i] < min_ctr ) {
+            min_ctr = _line_ctrs[set_no][i];
+            line_to_replace = i;
+        }
+    }
+    return line_to_replace;
+}
+
+/***********************************************************************************************
+ * RRPolicy 
+ * **********************************************************************************************/
+
+class RRPolicy : public ReplacementPolicy {
+    int _set_line_count;
+
+    public:
+    RRPolicy(int set_line_count) : _set_line_count(set_line_count) { srand(time(NULL)); }
+    int lineToReplace(int) { return rand() % _set_line_count; }
+};
+
+
+/***********************************************************************************************
+ * Global function definitions
+ * *********************************************************************************************/
+
+inline ReplacementPolicy *stringToRepPolicy(const char *rep_policy, int set_count,
+       int set_line_count) {
+    if (strcmp(rep_policy, "LRU") == 0) return new LRUPolicy(set_count, set_line_count);
+    else if (strcmp(rep_policy, "LFU") == 0) return new LFUPolicy(set_count, set_line_count);
+    else if (strcmp(rep_policy, "RR") == 0) return new RRPolicy(set_line_count);
+    else return NULL;
+}
+
+inline int log2(int n) {
+    int log2n = -1;
+    for (; n > 0; n >>= 1, ++log2n);
+    return log2n;
+}
+
+inline int bitMask(int no_of_bits) {
+    return (1 << no_of_bits) - 1;
+}
+
+/***********************************************************************************************
+ * CacheLine - Data structure for a single cache line
+ * *********************************************************************************************/
+
+struct CacheLine {
+    unsigned long _tag;
+    //int contents;
+    bool _valid;
+    bool _dirty;
+
+    public:
+    CacheLine() : _tag(0), _valid(false), _dirty(false) {}
+};
+
+/***********************************************************************************************
+ * WriteBuffer - A coalescing buffer of line sized entries sitting between a cache level
+ * and the next one (or memory)
+ *
+ * Writes to a line that already has an entry are merged into it. When the buffer is full
+ * the oldest entry is drained as a single write of the bytes it has collected.
+ * *********************************************************************************************/
+
+struct WriteBufferEntry {
+    unsigned long _line_addr;
+    unsigned long long _byte_mask; // one bit per _granularity bytes of the line
+    long _age;
+    bool _valid;
+
+    public:
+    WriteBufferEntry() : _line_addr(0), _byte_mask(0), _age(0), _valid(false) {}
+};
+
+/* Declarations */
+
+class CacheHierarchy;
+
+class WriteBuffer {
+    //Input parameters
+    int _entry_count;
+    int _line_size;
+    CacheHierarchy *_hierarchy;
+    int _target_level; // level written to when draining; memory if past the last level
+
+    //Computed parameters
+    int _granularity;
+    unsigned long long _full_mask;
+    long _age;
+    long _write_count;
+    long _coalesced_count;
+    long _full_drain_count;
+    long _partial_drain_count;
+    long _bytes_drained;
+
+    WriteBufferEntry *_entries;
+
+    void drain(int entry_no);
+
+    public:
+    WriteBuffer() : _entry_count(0) {}
+
+    //Allocate/Deallocate resources and initialize parameters
+    void initialize(int entry_count, int line_size, CacheHierarchy *hierarchy, int target_level);
+    void finalize();
+
+    //Accessors
+    bool enabled() { return _entry_count > 0; }
+
+    //Return statistics
+    long writeCount() { return _write_count; }
+    long coalescedCount() { return _coalesced_count; }
+    long fullDrainCount() { return _full_drain_count; }
+    long partialDrainCount() { return _partial_drain_count; }
+    long bytesDrained() { return _bytes_drained; }
+
+    void write(unsigned long addr, int size);
+    void flush();
+};
+
+/***********************************************************************************************
+ * Cache - Class which defines the data structures and methods for a single cache level
+ * *********************************************************************************************/
+
+/* Declarations */
+
+class Cache {
+    //Input parameters
+    int _level_no;
+    int _size;
+    int _line_size;
+    int _assoc;
+    int _hit_latency;
+    ReplacementPolicy *_rep_policy;
+    bool _write_through;
+    bool _write_allocate;
+    WriteBuffer *_write_buffer;
+
+    //Computed paramters
+    int _line_count;
+    int _set_count;
+    int _word_bits;
+    int _set_bits;
+    long _hit_count;
+    long _miss_count;
+
+    //Traffic to and from the next level
+    long _fill_count;
+    long _dirty_writeback_count;
+    long _clean_eviction_count;
+    long _back_invalidation_count;
+    long _forwarded_write_count;
+    long _forwarded_write_bytes;
+
+    CacheLine **_lines;
+
+    public:
+    
+    //Allocate/Deallocate resources and initialize parameters
+    void initialize(int level_no, int size, int line_size, int assoc,
+           int hit_latency, const char *rep_policy);
+    void setWritePolicy(bool write_through, bool write_allocate, int buffer_entries,
+           CacheHierarchy *hierarchy);
+    void finalize();
+
+    //Accessors
+    int level() { return _level_no; }
+    int lineCount() { return _line_count; }
+    int setCount() { return _set_count; }
+    int associativity() { return _assoc; }
+    int lineSize() { return _line_size; }
+    int hitLatency() { return _hit_latency; }
+    bool writeThrough() { return _write_through; }
+    bool writeAllocate() { return _write_allocate; }
+    WriteBuffer *writeBuffer() { return _write_buffer; }
+    bool isValidLine(int set_no, int line_no);
+    bool isDirtyLine(int set_no, int line_no);
+    unsigned long EAToTag(unsigned long addr) {
+        return addr & ~bitMask(_word_bits+_set_bits);
+    }
+    unsigned long EAToSetNo(unsigned long addr) {
+        return (addr >> _word_bits) & bitMask(_set_bits);
+    }
+    unsigned long EAToWordInSet(unsigned long addr) {
+        return addr & bitMask(_word_bits);
+    }
+    unsigned long TagSetToEA(unsigned long tag, unsigned long set) {
+        return tag | (set << _word_bits);
+    }
+
+    //Return statistics
+    long memoryAccesses() { return _hit_count + 2*_miss_count; }
+    long hitCount() { return _hit_count; }
+    long missCount() { return _miss_count; }
+    double missRate() { return (double)(_miss_count) / (_hit_count+_miss_count); }
+    long fillCount() { return _fill_count; }
+    long dirtyWritebackCount() { return _dirty_writeback_count; }
+    long cleanEvictionCount() { return _clean_eviction_count; }
+    long backInvalidationCount() { return _back_invalidation_count; }
+    long bytesIn() { return _fill_count * _line_size; }
+    long forwardedWriteCount() { return _forwarded_write_count; }
+    long bytesOut() {
+        return _dirty_writeback_count * _line_size + _forwarded_write_bytes
+            + (_write_buffer ? _write_buffer->bytesDrained() : 0);
+    }
+
+    int lineToReplace(int set_no);
+    bool probe(unsigned long addr, int &set_no, int &line_no);
+    bool findAddress(unsigned long addr, int &set_no, int &line_no);
+
+    //Simulate a cache hierarchy
+    friend class CacheHierarchy;
+};
+
+/* Definitions */
+
+// Memory allocation and parameter initialization
+inline void Cache::initialize(int level_no, int size, int line_size,
+       int assoc, int hit_latency, const char *rep_policy) {
+    _level_no = level_no;
+    _size = size;
+    _line_size = line_size;
+    _assoc = assoc;
+    _hit_latency = hit_latency;
+    _line_count = _size*K / _line_size;
+    _set_count = _line_count / _assoc;
+    _word_bits = log2(_line_size);
+    _set_bits = log2(_set_count);
+    _hit_count = _miss_count = 0;
+    _fill_count = _dirty_writeback_count = _clean_eviction_count = 0;
+    _back_invalidation_count = 0;
+    _forwarded_write_count = _forwarded_write_bytes = 0;
+    _write_through = false;
+    _write_allocate = true;
+    _write_buffer = NULL;
+
+    /*================================================================
+     * NOTE:- Replacement policy must be initialized after the other
+     * parameters since the internal data structures of a replacement
+     *  policy may require some of these values
+     ================================================================= */
+    _rep_policy = stringToRepPolicy(rep_policy, _set_count, _assoc);
+
+    _lines = new CacheLine*[_set_count];
+    for (int i = 0; i < _set_count; ++i) {
+        _lines[i] = new CacheLine[_assoc];
+    }
+}
+
+// Write hit and write miss policies. Writes leaving this level (write-through, or
+// write-around when not allocating) go through a coalescing buffer of buffer_entries
+// lines if buffer_entries > 0, and straight to the next level otherwise.
+inline void Cache::setWritePolicy(bool write_through, bool write_allocate, int buffer_entries,
+        CacheHierarchy *hierarchy) {
+    _write_through = write_through;
+    _write_allocate = write_allocate;
+    if (buffer_entries > 0) {
+        // Level numbers start at 1, so _level_no is the index of the next level
+        _write_buffer = new WriteBuffer;
+        _write_buffer->initialize(buffer_entries, _line_size, hierarchy, _level_no);
+    }
+}
+
+// Deallocation of resources
+inline void Cache::finalize() {
+    for (int i = 0; i < _set_count; ++i)
+        delete[] _lines[i];
+    delete[] _lines;
+    delete _rep_policy;
+    if (_write_buffer)
+        _write_buffer->finalize();
+    delete _write_buffer;
+}
+
+// State of the line at (set_no, line_no)
+inline bool Cache::isValidLine(int set_no, int line_no) {
+    return _lines[set_no][line_no]._valid;
+}
+
+inline bool Cache::isDirtyLine(int set_no, int line_no) {
+    return _lines[set_no][line_no]._valid && _lines[set_no][line_no]._dirty;
+}
+
+// Chooses an invalid line to be replaced if the set is not full;
+// a line as per the replacement policy otherwise
+inline int Cache::lineToReplace(int set_no) {
+    for (int i = 0; i < _assoc; ++i) {
+        if (!_lines[set_no][i]._valid)
+            return i;
+    }
+    return _rep_policy->lineToReplace(set_no);
+}
+
+// Returns true if addr is there in this cache level. In this case, (set_no, line_no) gives
+// the cache line containing addr. Has no side effects on the replacement policy.
+inline bool Cache::probe(unsigned long addr, int &set_no, int &line_no) {
+    set_no = EAToSetNo(addr);
+    for (int i = 0; i < _assoc; ++i) {
+        if (_lines[set_no][i]._tag == EAToTag(addr) && _lines[set_no][i]._valid) {
+            line_no = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns true if addr is there in this cache level. In this case, (set_no, line_no) gives
+// the cache line containing addr.
+// Returns false if addr is not there. Here, (set_no, line_no) gives the cache line where
+// addr should be put as per the replacement policy.
+inline bool Cache::findAddress(unsigned long addr, int &set_no, int &line_no) {
+    if (probe(addr, set_no, line_no))
+        return true;
+    line_no = lineToReplace(set_no);
+    return false;
+}
+
+/*******************************************************************************************
+ * TLB MODEL SECTION
+ *
+ * This section contains the TLBs, the page table walker and the physical page allocator
+ * used to translate the virtual addresses seen by a front end into physical addresses
+ * before they are looked up in the cache hierarchy
+*******************************************************************************************/
+
+/***********************************************************************************************
+ * PageAllocator - Hands out physical frames on first touch of a virtual page
+ *
+ * With page colouring enabled, a virtual page is given a frame of the same colour (the
+ * low bits of the frame number that overlap the set index of a physically-indexed cache).
+ * Without colouring, frames are scattered across physical memory to mimic a fragmented
+ * free list.
+ * *********************************************************************************************/
+
+class PageAllocator {
+    int _page_bits;
+    int _color_count;
+    unsigned long _frame_count;
+    unsigned long _next_frame;
+    unsigned long *_next_in_color;
+    unsigned long _table_count;
+    unsigned long _shared_frames;   // pages given a frame already in use, memory being full
+    std::map<unsigned long, unsigned long> _page_map;
+    std::map<unsigned long, unsigned long> _table_map[4]; // table id -> frame, per walk level
+
+    public:
+    void initialize(int page_bits, unsigned long phys_mem_bytes, int color_count);
+    void finalize();
+
+    int pageBits() { return _page_bits; }
+    unsigned long pagesMapped() { return _page_map.size(); }
+    unsigned long tablesAllocated() { return _table_count; }
+    unsigned long sharedFrames() { return _shared_frames; }
+
+    unsigned long frameFor(unsigned long vpn);
+    unsigned long tableFrame(int level, unsigned long table_id);
+};
+
+inline void PageAllocator::initialize(int page_bits, unsigned long phys_mem_bytes, int color_count) {
+    _page_bits = page_bits;
+    _color_count = color_count;
+    _frame_count = phys_mem_bytes >> page_bits;
+    _next_frame = 0;
+    _table_count = 0;
+    _shared_frames = 0;
+    _next_in_color = NULL;
+    if (_color_count > 0) {
+        _next_in_color = new unsigned long[_color_count];
+        for (int c = 0; c < _color_count; ++c)
+            _next_in_color[c] = 0;
+    }
+}
+
+inline void PageAllocator::finalize() {
+    delete[] _next_in_color;
+    _page_map.clear();
+    for (int level = 0; level < 4; ++level)
+        _table_map[level].clear();
+}
+
+// Returns the physical frame backing virtual page vpn, allocating one if the page
+// has not been touched before. Once the frames (of its colour) are used up, a new page
+// shares a frame with an earlier one, which is counted.
+inline unsigned long PageAllocator::frameFor(unsigned long vpn) {
+    std::map<unsigned long, unsigned long>::iterator it = _page_map.find(vpn);
+    if (it != _page_map.end())
+        return it->second;
+
+    unsigned long pfn;
+    if (_color_count > 0) {
+        int color = vpn % _color_count;
+        pfn = _next_in_color[color]++ * _color_count + color;
+        if (pfn >= _frame_count) {
+            _shared_frames++;
+            pfn %= _frame_count;
+        }
+    } else {
+        if (_page_map.size() >= _frame_count)
+            _shared_frames++;
+        // Full period linear congruential sequence over the (power of two) frame
+        // space: every frame is handed out exactly once, in scattered order
+        _next_frame = (_next_frame * 1103515245UL + 12345UL) & (_frame_count - 1);
+        pfn = _next_frame;
+    }
+    _page_map[vpn] = pfn;
+    return pfn;
+}
+
+// Returns the frame holding the page table with the given id at a level of the walk.
+// Page table pages are always 4KB and live in a region just above the frames used
+// for data pages.
+inline unsigned long PageAllocator::tableFrame(int level, unsigned long table_id) {
+    std::map<unsigned long, unsigned long>::iterator it = _table_map[level].find(table_id);
+    if (it != _table_map[level].end())
+        return it->second;
+    unsigned long frame = ((_frame_count << _page_bits) >> 12) + _table_count++;
+    _table_map[level][table_id] = frame;
+    return frame;
+}
+
+/***********************************************************************************************
+ * TLB - A set-associative translation lookaside buffer holding VPN -> PFN mappings
+ * *********************************************************************************************/
+
+struct TLBEntry {
+    unsigned long _vpn;
+    unsigned long _pfn;
+    bool _valid;
+
+    public:
+    TLBEntry() : _vpn(0), _pfn(0), _valid(false) {}
+};
+
+/* Declarations */
+
+class TLB {
+    //Input parameters
+    const char *_name;
+    int _entry_count;
+    int _assoc;
+    int _hit_latency;
+    ReplacementPolicy *_rep_policy;
+
+    //Computed parameters
+    int _set_count;
+    long _hit_count;
+    long _miss_count;
+
+    TLBEntry **_entries;
+
+    public:
+    TLB() : _name(""), _entry_count(0), _hit_count(0), _miss_count(0) {}
+
+    //Allocate/Deallocate resources and initialize parameters
+    void initialize(const char *name, int entry_count, int assoc,
+           int hit_latency, const char *rep_policy);
+    void finalize();
+
+    //Accessors
+    const char *name() { return _name; }
+    bool enabled() { return _entry_count > 0; }
+
+    //Return statistics
+    long hitCount() { return _hit_count; }
+    long missCount() { return _miss_count; }
+    double missRate() { return (double)(_miss_count) / (_hit_count+_miss_count); }
+
+    bool lookup(unsigned long vpn, unsigned long &pfn);
+    void insert(unsigned long vpn, unsigned long pfn);
+};
+
+/* Definitions */
+
+inline void TLB::initialize(const char *name, int entry_count, int assoc,
+        int hit_latency, const char *rep_policy) {
+    _name = name;
+    _entry_count = entry_count;
+    _assoc = assoc;
+    _hit_latency = hit_latency;
+    _set_count = _entry_count / _assoc;
+    _hit_count = _miss_count = 0;
+    _rep_policy = stringToRepPolicy(rep_policy, _set_count, _assoc);
+
+    _entries = new TLBEntry*[_set_count];
+    for (int i = 0; i < _set_count; ++i) {
+        _entries[i] = new TLBEntry[_assoc];
+    }
+}
+
+inline void TLB::finalize() {
+    if (!enabled())
+        return;
+    for (int i = 0; i < _set_count; ++i)
+        delete[] _entries[i];
+    delete[] _entries;
+    delete _rep_policy;
+    _entry_count = 0;
+}
+
+// Returns true and the frame number in pfn if vpn is mapped by this TLB
+inline bool TLB::lookup(unsigned long vpn, unsigned long &pfn) {
+    int set_no = vpn % _set_count;
+    for (int i = 0; i < _assoc; ++i) {
+        TLBEntry &e = _entries[set_no][i];
+        if (e._valid && e._vpn == vpn) {
+            _hit_count++;
+            _rep_policy->updateCounters(set_no, i);
+            pfn = e._pfn;
+            return true;
+        }
+    }
+    _miss_count++;
+    return false;
+}
+
+// Fills a translation into the TLB, replacing an invalid entry if there is one
+inline void TLB::insert(unsigned long vpn, unsigned long pfn) {
+    int set_no = vpn % _set_count;
+    int way = -1;
+    for (int i = 0; i < _assoc && way < 0; ++i) {
+        if (!_entries[set_no][i]._valid)
+            way = i;
+    }
+    if (way < 0)
+        way = _rep_policy->lineToReplace(set_no);
+    TLBEntry &e = _entries[set_no][way];
+    e._vpn = vpn;
+    e._pfn = pfn;
+    e._valid = true;
+    _rep_policy->updateCounters(set_no, way);
+}
+
+/*******************************************************************************************
+ * CACHE HIERARCHY SECTION
+ *
+ * CacheHierarchy owns the cache levels, TLBs and write combining buffer of one simulated
+ * memory system and performs the simulations across its levels. A front end builds one
+ * from a configuration file (or level by level) and feeds it the accesses it observes.
+*******************************************************************************************/
+
+/* Declarations */
+
+class CacheHierarchy {
+    std::vector<Cache> _levels;
+    int _memory_latency;
+
+    // Address translation. Translation is only modelled when enabled (by a [TLB] section
+    // in the configuration file); otherwise the caches are indexed with virtual addresses.
+    bool _translation_enabled;
+    TLB _dtlb, _itlb, _stlb;
+    PageAllocator _page_allocator;
+    long _walk_count;
+    long _walk_accesses;
+    long _instruction_count;
+
+    // Non-temporal stores skip the caches and are combined in this buffer on their way to
+    // memory, unless the buffer is disabled, which treats them as plain stores
+    WriteBuffer _wc_buffer;
+    long _streaming_store_count;
+
+    // Each hierarchy owns heap state through its levels, so it is not copyable
+    CacheHierarchy(const CacheHierarchy &);
+    CacheHierarchy &operator=(const CacheHierarchy &);
+
+    unsigned long walkPageTable(unsigned long vpn);
+    unsigned long translateAddress(TLB &l1_tlb, unsigned long addr);
+
+    public:
+    CacheHierarchy();
+    ~CacheHierarchy() { finalize(); }
+
+    //Build the hierarchy, either from a configuration file or level by level
+    bool readConfig(const char *conf_filename, const char *rep_policy_override = NULL);
+    Cache &addLevel(int size, int line_size, int assoc, int hit_latency, const char *rep_policy);
+    void setMemoryLatency(int latency) { _memory_latency = latency; }
+    void enableTranslation(int page_bits, unsigned long phys_mem_bytes, int color_count);
+    void setWriteCombining(int entry_count);
+    void finalize();
+
+    //Accessors
+    int levelCount() { return _levels.size(); }
+    Cache &level(int level_index) { return _levels[level_index]; }
+    int memoryLatency() { return _memory_latency; }
+    bool translationEnabled() { return _translation_enabled; }
+    TLB &itlb() { return _itlb; }
+    TLB &dtlb() { return _dtlb; }
+    TLB &stlb() { return _stlb; }
+    PageAllocator &pageAllocator() { return _page_allocator; }
+    WriteBuffer &writeCombiningBuffer() { return _wc_buffer; }
+
+    // Latency of an access that was satisfied by the level at hit_level (memory if
+    // hit_level is levelCount())
+    int latency(int hit_level) {
+        return (hit_level < levelCount()) ? _levels[hit_level].hitLatency() : _memory_latency;
+    }
+
+    //Return statistics
+    long instructionCount() { return _instruction_count; }
+    long walkCount() { return _walk_count; }
+    long walkAccesses() { return _walk_accesses; }
+    long streamingStoreCount() { return _streaming_store_count; }
+
+    //Accesses made by a front end. instFetch() and read() return the index of the level
+    //that supplied the data, levelCount() if it came from memory.
+    int instFetch(unsigned long addr);
+    int read(unsigned long addr);
+    void write(unsigned long addr, int size);
+    void streamingWrite(unsigned long addr, int size);
+
+    //Simulate a cache hierarchy starting from a given level
+    int readAddress(int level_index, unsigned long addr);
+    void writeAddress(int level_index, unsigned long addr, int size);
+    void forwardWrite(int level_index, unsigned long addr, int size);
+    void invalidateAddress(unsigned long addr);
+    void evictLinesFromCache(int start_level, int set_no, int line_no);
+    void writeBackLine(int level_index, unsigned long line_addr, int line_size);
+
+    //Statistics
+    void flushWriteBuffers();
+    void printStatistics(FILE *out);
+};
+
+/* Definitions */
+
+inline CacheHierarchy::CacheHierarchy() : _memory_latency(0), _translation_enabled(false),
+    _walk_count(0), _walk_accesses(0), _instruction_count(0), _streaming_store_count(0) {}
+
+// Appends a level below the existing ones. Levels are numbered from 1, closest to the
+// core first.
+inline Cache &CacheHierarchy::addLevel(int size, int line_size, int assoc, int hit_latency,
+        const char *rep_policy) {
+    _levels.push_back(Cache());
+    Cache &clevel = _levels.back();
+    clevel.initialize(_levels.size(), size, line_size, assoc, hit_latency, rep_policy);
+    return clevel;
+}
+
+// Translate addresses before they reach the caches, using pages of 2^page_bits bytes.
+// color_count > 0 turns on page colouring in the physical page allocator.
+inline void CacheHierarchy::enableTranslation(int page_bits, unsigned long phys_mem_bytes,
+        int color_count) {
+    _page_allocator.initialize(page_bits, phys_mem_bytes, color_count);
+    _translation_enabled = true;
+}
+
+// Write combining buffers hold memory lines, i.e. lines of the last level. Must be
+// called after the last level has been added.
+inline void CacheHierarchy::setWriteCombining(int entry_count) {
+    _wc_buffer.finalize();
+    if (entry_count > 0)
+        _wc_buffer.initialize(entry_count, _levels.back().lineSize(), this, levelCount());
+}
+
+// Release every level so that the hierarchy can be built again
+inline void CacheHierarchy::finalize() {
+    _itlb.finalize();
+    _dtlb.finalize();
+    _stlb.finalize();
+    if (_translation_enabled) {
+        _page_allocator.finalize();
+        _translation_enabled = false;
+    }
+    _wc_buffer.finalize();
+    for (int i = 0; i < levelCount(); ++i)
+        _levels[i].finalize();
+    _levels.clear();
+    _instruction_count = _walk_count = _walk_accesses = _streaming_store_count = 0;
+}
+
+// Performs removal of all cache lines triggered due to the eviction of the line
+// at (set_no, line_no) at the cache level start_level.
+// The hierarchy is inclusive, so every copy of the victim's data in the levels closer
+// to the core is back-invalidated first. Dirty data found there is merged into the
+// victim, which is then written back to the next level if it is dirty.
+inline void CacheHierarchy::evictLinesFromCache(int start_level, int set_no, int line_no) {
+
+    Cache &slevel = _levels[start_level];
+
+    // evict line from start_level
+    CacheLine &victim = slevel._lines[set_no][line_no];
+    if (!victim._valid)
+        return;
+
+    victim._valid = false;
+    bool dirty = victim._dirty;
+    unsigned long victim_addr = slevel.TagSetToEA(victim._tag, set_no);
+    unsigned long victim_end = victim_addr + slevel._line_size;
+
+    // iteratively move down the hierarchy removing required lines
+    for (int level_index = start_level-1; level_index >= 0; --level_index) {
+
+        Cache &clevel = _levels[level_index]; // clevel is current cache level
+
+        // If the cache line size of the current level is smaller than the victim's,
+        // several lines of the current level hold parts of the victim
+        for (unsigned long addr = victim_addr & ~bitMask(clevel._word_bits);
+                addr < victim_end; addr += clevel._line_size) {
+
+            int cset_no, cline_no;
+            if (!clevel.probe(addr, cset_no, cline_no))
+                continue;
+
+            CacheLine &line = clevel._lines[cset_no][cline_no];
+            line._valid = false;
+            clevel._back_invalidation_count++;
+            dirty = dirty || line._dirty;
+        }
+    }
+
+    if (dirty) {
+        slevel._dirty_writeback_count++;
+        writeBackLine(start_level+1, victim_addr, slevel._line_size);
+    } else {
+        slevel._clean_eviction_count++;
+    }
+}
+
+// Writes a line evicted from the level above level_index into it. If level_index has
+// smaller lines than the evicted one, multiple lines are written. Writebacks past the
+// last level go to memory and are only counted at the evicting level.
+inline void CacheHierarchy::writeBackLine(int level_index, unsigned long line_addr, int line_size) {
+    if (level_index >= levelCount())
+        return;
+    Cache &nlevel = _levels[level_index];
+    int size = (nlevel._line_size < line_size) ? nlevel._line_size : line_size;
+    for (unsigned long addr = line_addr; addr < line_addr + line_size;
+            addr += nlevel._line_size) {
+        writeAddress(level_index, addr, size);
+    }
+}
+
+// Read an address from the cache hierarchy starting from a given level. Returns the
+// index of the level that had the data, levelCount() if it came from memory.
+inline int CacheHierarchy::readAddress(int level_index, unsigned long addr) {
+    if (level_index >= levelCount())
+        return level_index;
+    Cache &clevel = _levels[level_index];
+    int set_no = -1, line_no = -1;
+    int hit_level = level_index;
+    bool hit = clevel.findAddress(addr, set_no, line_no);
+    if (hit) {
+        clevel._hit_count++;
+    } else {
+        hit_level = readAddress(level_index+1, addr);
+        clevel._miss_count++;
+        clevel._fill_count++;
+        line_no = clevel.lineToReplace(set_no);
+        // remove this line from this and lower levels
+        evictLinesFromCache(level_index, set_no, line_no);
+        // fill the new line into the cache
+        CacheLine &line = clevel._lines[set_no][line_no];
+        line._tag = clevel.EAToTag(addr);
+        line._valid = true;
+        line._dirty = false;
+    }
+    clevel._rep_policy->updateCounters(set_no, line_no);
+    return hit_level;
+}
+
+// Write size bytes at an address to the cache hierarchy starting from a given level
+inline void CacheHierarchy::writeAddress(int level_index, unsigned long addr, int size) {
+    if (level_index >= levelCount())
+        return;
+    Cache &clevel = _levels[level_index];
+    int set_no = -1, line_no = -1;
+    bool hit = clevel.findAddress(addr, set_no, line_no);
+    if (hit) {
+        clevel._hit_count++;
+    } else {
+        clevel._miss_count++;
+        // With no-write-allocate the write goes around this level
+        if (!clevel._write_allocate) {
+            forwardWrite(level_index, addr, size);
+            return;
+        }
+        readAddress(level_index+1, addr);
+        clevel._fill_count++;
+        line_no = clevel.lineToReplace(set_no);
+        // remove this line from this and lower levels
+        evictLinesFromCache(level_index, set_no, line_no);
+        // fill the new line into the cache
+        CacheLine &line = clevel._lines[set_no][line_no];
+        line._tag = clevel.EAToTag(addr);
+        line._valid = true;
+        line._dirty = false;
+    }
+    // A write-through level passes the write on; a write-back level marks the line modified
+    if (clevel._write_through)
+        forwardWrite(level_index, addr, size);
+    else
+        clevel._lines[set_no][line_no]._dirty = true;
+    clevel._rep_policy->updateCounters(set_no, line_no);
+}
+
+// Send a write that leaves level_index (write-through or write-around) on to the next
+// level, through the level's write buffer if it has one
+inline void CacheHierarchy::forwardWrite(int level_index, unsigned long addr, int size) {
+    Cache &clevel = _levels[level_index];
+    clevel._forwarded_write_count++;
+    if (clevel._write_buffer) {
+        clevel._write_buffer->write(addr, size);
+    } else {
+        clevel._forwarded_write_bytes += size;
+        writeAddress(level_index+1, addr, size);
+    }
+}
+
+// Remove the line holding addr from every level, writing it back first if dirty.
+// Used by streaming stores, which must not leave a stale copy in the caches.
+inline void CacheHierarchy::invalidateAddress(unsigned long addr) {
+    for (int level_index = levelCount()-1; level_index >= 0; --level_index) {
+        int set_no, line_no;
+        if (_levels[level_index].probe(addr, set_no, line_no))
+            evictLinesFromCache(level_index, set_no, line_no);
+    }
+}
+
+// Walk the x86-64 radix page table for vpn. Every level of the walk reads one 8 byte
+// entry through the data cache hierarchy. With 2MB pages the walk ends one level early
+// at the page directory.
+inline unsigned long CacheHierarchy::walkPageTable(unsigned long vpn) {
+    int page_bits = _page_allocator.pageBits();
+    unsigned long vaddr = vpn << page_bits;
+    int leaf_shift = (page_bits >= 21) ? 21 : 12;
+
+    _walk_count++;
+    for (int level = 0, shift = 39; shift >= leaf_shift; ++level, shift -= 9) {
+        // The table at this level is identified by the address bits above the ones it indexes
+        unsigned long frame = _page_allocator.tableFrame(level, vaddr >> (shift+9));
+        unsigned long pte_addr = (frame << 12) | (((vaddr >> shift) & bitMask(9)) << 3);
+        readAddress(0, pte_addr);
+        _walk_accesses++;
+    }
+    return _page_allocator.frameFor(vpn);
+}
+
+// Translate a virtual address through a first level TLB, the shared STLB and,
+// failing both, a page walk
+inline unsigned long CacheHierarchy::translateAddress(TLB &l1_tlb, unsigned long addr) {
+    int page_bits = _page_allocator.pageBits();
+    unsigned long vpn = addr >> page_bits;
+    unsigned long offset = addr & bitMask(page_bits);
+    unsigned long pfn;
+
+    if (!l1_tlb.lookup(vpn, pfn)) {
+        if (!_stlb.enabled() || !_stlb.lookup(vpn, pfn)) {
+            pfn = walkPageTable(vpn);
+            if (_stlb.enabled())
+                _stlb.insert(vpn, pfn);
+        }
+        l1_tlb.insert(vpn, pfn);
+    }
+    return (pfn << page_bits) | offset;
+}
+
+// Simulate an instruction fetch
+inline int CacheHierarchy::instFetch(unsigned long addr) {
+    _instruction_count++;
+    if (_translation_enabled)
+        addr = translateAddress(_itlb, addr);
+    return readAddress(0, addr);
+}
+
+// Simulate a memory read access
+inline int CacheHierarchy::read(unsigned long addr) {
+    if (_translation_enabled)
+        addr = translateAddress(_dtlb, addr);
+    return readAddress(0, addr);
+}
+
+// Simulate a memory write access of size bytes
+inline void CacheHierarchy::write(unsigned long addr, int size) {
+    if (_translation_enabled)
+        addr = translateAddress(_dtlb, addr);
+    writeAddress(0, addr, size);
+}
+
+// Simulate a non-temporal store. It bypasses the caches and is collected in the
+// write combining buffer on its way to memory.
+inline void CacheHierarchy::streamingWrite(unsigned long addr, int size) {
+    if (!_wc_buffer.enabled()) {
+        write(addr, size);
+        return;
+    }
+    if (_translation_enabled)
+        addr = translateAddress(_dtlb, addr);
+    _streaming_store_count++;
+    invalidateAddress(addr);
+    _wc_buffer.write(addr, size);
+}
+
+/***********************************************************************************************
+ * WriteBuffer definitions (they need the complete CacheHierarchy to drain into)
+ * *********************************************************************************************/
+
+inline void WriteBuffer::initialize(int entry_count, int line_size, CacheHierarchy *hierarchy,
+        int target_level) {
+    _entry_count = entry_count;
+    _line_size = line_size;
+    _hierarchy = hierarchy;
+    _target_level = target_level;
+    _granularity = (_line_size > 64) ? _line_size / 64 : 1;
+    int bits = _line_size / _granularity;
+    _full_mask = (bits == 64) ? ~0ULL : (1ULL << bits) - 1;
+    _age = 0;
+    _write_count = _coalesced_count = 0;
+    _full_drain_count = _partial_drain_count = _bytes_drained = 0;
+    _entries = new WriteBufferEntry[_entry_count];
+}
+
+inline void WriteBuffer::finalize() {
+    if (!enabled())
+        return;
+    delete[] _entries;
+    _entry_count = 0;
+}
+
+// Buffer a write of size bytes at addr, splitting it if it crosses a line boundary
+inline void WriteBuffer::write(unsigned long addr, int size) {
+    unsigned long end = addr + size;
+    while (addr < end) {
+        unsigned long line_addr = addr & ~(unsigned long)(_line_size-1);
+        unsigned long chunk_end = (line_addr + _line_size < end) ? line_addr + _line_size : end;
+        int first = (addr - line_addr) / _granularity;
+        int last = (chunk_end - 1 - line_addr) / _granularity;
+        unsigned long long mask = ((last == 63) ? ~0ULL : (1ULL << (last+1)) - 1)
+            & ~((1ULL << first) - 1);
+
+        _write_count++;
+        int entry_no = -1, free_no = -1, oldest_no = 0;
+        for (int i = 0; i < _entry_count; ++i) {
+            WriteBufferEntry &e = _entries[i];
+            if (e._valid && e._line_addr == line_addr)
+                entry_no = i;
+            else if (!e._valid && free_no < 0)
+                free_no = i;
+            if (e._valid && e._age < _entries[oldest_no]._age)
+                oldest_no = i;
+        }
+
+        if (entry_no >= 0) {
+            _coalesced_count++;
+        } else {
+            if (free_no < 0) {
+                drain(oldest_no);
+                free_no = oldest_no;
+            }
+            entry_no = free_no;
+            _entries[entry_no]._valid = true;
+            _entries[entry_no]._line_addr = line_addr;
+            _entries[entry_no]._byte_mask = 0;
+            _entries[entry_no]._age = _age++;
+        }
+        _entries[entry_no]._byte_mask |= mask;
+        addr = chunk_end;
+    }
+}
+
+// Write the bytes collected by an entry to the target level and free the entry
+inline void WriteBuffer::drain(int entry_no) {
+    WriteBufferEntry &e = _entries[entry_no];
+    int bytes = __builtin_popcountll(e._byte_mask) * _granularity;
+    if (e._byte_mask == _full_mask)
+        _full_drain_count++;
+    else
+        _partial_drain_count++;
+    _bytes_drained += bytes;
+    e._valid = false;
+    _hierarchy->writeAddress(_target_level, e._line_addr, bytes);
+}
+
+// Drain all pending entries, oldest first
+inline void WriteBuffer::flush() {
+    for (;;) {
+        int oldest_no = -1;
+        for (int i = 0; i < _entry_count; ++i) {
+            if (_entries[i]._valid && (oldest_no < 0 || _entries[i]._age < _entries[oldest_no]._age))
+                oldest_no = i;
+        }
+        if (oldest_no < 0)
+            return;
+        drain(oldest_no);
+    }
+}
+
+
+/*******************************************************************************************
+ * CONFIGURATION AND STATISTICS SECTION
+*******************************************************************************************/
+
+// Builds the hierarchy described by a configuration file, replacing any earlier one.
+// A non-NULL rep_policy_override replaces the replacement policy given for every cache
+// level. Returns false if the file cannot be read, describes no cache level or has a
+// physical memory size that is not a power of two.
+inline bool CacheHierarchy::readConfig(const char *conf_filename, const char *rep_policy_override)
+{
+    finalize();
+    FILE *conf_file = fopen(conf_filename, "r");
+    if (!conf_file)
+        return false;
+    int level_count = 0;
+    int nargs = fscanf(conf_file, "Levels = %d\n", &level_count);
+    for (int i = 0; i < level_count; ++i)
+    {
+        int level_no, size, line_size, assoc, hit_latency;
+        char rep_policy[5];
+        nargs = fscanf(conf_file, "\n[Level %d]\n", &level_no);
+        nargs = fscanf(conf_file, "Size = %dKB\n", &size);
+        nargs = fscanf(conf_file, "Associativity = %d\n", &assoc);
+        nargs = fscanf(conf_file, "Block_size = %dbytes\n", &line_size);
+        nargs = fscanf(conf_file, "Hit_Latency = %d\n", &hit_latency);
+        nargs = fscanf(conf_file, "Replacement_Policy = %4s\n", rep_policy);
+        Cache &clevel = addLevel(size, line_size, assoc, hit_latency,
+                rep_policy_override ? rep_policy_override : rep_policy);
+
+        // Optional write policy settings. The defaults are write-back, write-allocate
+        // with no write buffer.
+        char key[32], hit_policy[4] = "WB", miss_policy[4] = "WA";
+        int buffer_entries = 0;
+        while (fscanf(conf_file, " %31[A-Za-z_] =", key) == 1)
+        {
+            if (strcmp(key, "Write_Policy") == 0)
+                nargs = fscanf(conf_file, " %3s %3s\n", hit_policy, miss_policy);
+            else if (strcmp(key, "Write_Buffer") == 0)
+                nargs = fscanf(conf_file, " %d\n", &buffer_entries);
+        }
+        clevel.setWritePolicy(strcmp(hit_policy, "WT") == 0,
+                strcmp(miss_policy, "NWA") != 0, buffer_entries, this);
+    }
+    nargs = fscanf(conf_file, "\n[Main Memory]\n");
+    nargs = fscanf(conf_file, "Hit Latency = %d", &_memory_latency);
+
+    // Optional sections following main memory
+    char section[32];
+    int wc_entries = 10;
+    while (fscanf(conf_file, " [%31[^]]]\n", section) == 1)
+    {
+        if (strcmp(section, "TLB") == 0)
+        {
+            int page_size, phys_mem, colors;
+            char page_unit[3];
+            nargs = fscanf(conf_file, "Page_Size = %d%2s\n", &page_size, page_unit);
+            nargs = fscanf(conf_file, "Physical_Memory = %dMB\n", &phys_mem);
+            nargs = fscanf(conf_file, "Page_Colors = %d\n", &colors);
+            if (strcmp(page_unit, "MB") == 0)
+                page_size *= K;
+            // Frames are numbered by a sequence that covers a power of two of them
+            if (phys_mem <= 0 || (phys_mem & (phys_mem - 1)) != 0
+                    || (unsigned long)phys_mem*K < (unsigned long)page_size) {
+                fclose(conf_file);
+                return false;
+            }
+            enableTranslation(log2(page_size*K), (unsigned long)phys_mem*K*K, colors);
+        }
+        else if (strcmp(section, "DTLB") == 0 || strcmp(section, "ITLB") == 0
+                || strcmp(section, "STLB") == 0)
+        {
+            int entries, assoc, hit_latency;
+            char rep_policy[5];
+            nargs = fscanf(conf_file, "Entries = %d\n", &entries);
+            nargs = fscanf(conf_file, "Associativity = %d\n", &assoc);
+            nargs = fscanf(conf_file, "Hit_Latency = %d\n", &hit_latency);
+            nargs = fscanf(conf_file, "Replacement_Policy = %4s\n", rep_policy);
+            TLB &tlb = (section[0] == 'D') ? _dtlb : (section[0] == 'I') ? _itlb : _stlb;
+            tlb.initialize(section[0] == 'D' ? "DTLB" : section[0] == 'I' ? "ITLB" : "STLB",
+                    entries, assoc, hit_latency, rep_policy);
+        }
+        else if (strcmp(section, "Write Combining") == 0)
+        {
+            nargs = fscanf(conf_file, "Entries = %d\n", &wc_entries);
+        }
+    }
+    nargs++;
+    fclose(conf_file);
+
+    if (levelCount() == 0)
+        return false;
+    setWriteCombining(wc_entries);
+
+    // A [TLB] section without first level TLBs still translates, walking on every access
+    if (_translation_enabled && !_dtlb.enabled())
+        _dtlb.initialize("DTLB", 1, 1, 1, "LRU");
+    if (_translation_enabled && !_itlb.enabled())
+        _itlb.initialize("ITLB", 1, 1, 1, "LRU");
+    return true;
+}
+
+// Drain pending buffered writes so that they show up in the statistics
+inline void CacheHierarchy::flushWriteBuffers()
+{
+    // Buffers closer to the core go first as they drain into the later ones
+    if (_wc_buffer.enabled())
+        _wc_buffer.flush();
+    for (int i = 0; i < levelCount(); ++i)
+    {
+        if (_levels[i].writeBuffer())
+            _levels[i].writeBuffer()->flush();
+    }
+}
+
+// Print the statistics gathered for every level, the links between them and the TLBs
+inline void CacheHierarchy::printStatistics(FILE *out)
+{
+    for (int i = 0; i < levelCount(); ++i)
+    {
+        fprintf(out, "Level %d:-\n", _levels[i].level());
+        fprintf(out, "Miss ratio = %lf\n", _levels[i].missRate());
+        fprintf(out, "Cache hits = %ld\n", _levels[i].hitCount());
+        fprintf(out, "Total memory accesses = %ld\n", _levels[i].memoryAccesses());
+        fprintf(out, "Line fills = %ld\n", _levels[i].fillCount());
+        fprintf(out, "Dirty writebacks = %ld\n", _levels[i].dirtyWritebackCount());
+        fprintf(out, "Clean evictions = %ld\n", _levels[i].cleanEvictionCount());
+        fprintf(out, "Back-invalidations = %ld\n", _levels[i].backInvalidationCount());
+        fprintf(out, "Write policy = %s, %s\n",
+                _levels[i].writeThrough() ? "write-through" : "write-back",
+                _levels[i].writeAllocate() ? "write-allocate" : "no-write-allocate");
+        fprintf(out, "Writes passed to next level = %ld\n", _levels[i].forwardedWriteCount());
+        WriteBuffer *wb = _levels[i].writeBuffer();
+        if (wb)
+        {
+            fprintf(out, "Write buffer: %ld writes, %ld coalesced, %ld full-line and %ld partial drains\n",
+                    wb->writeCount(), wb->coalescedCount(),
+                    wb->fullDrainCount(), wb->partialDrainCount());
+        }
+        fprintf(out, "\n");
+    }
+
+    // Bytes moved over the link between each level and the next one (or memory)
+    fprintf(out, "Traffic:-\n");
+    for (int i = 0; i < levelCount(); ++i)
+    {
+        long bytes_in = _levels[i].bytesIn(), bytes_out = _levels[i].bytesOut();
+        if (i+1 < levelCount())
+            fprintf(out, "L%d <-> L%d: ", _levels[i].level(), _levels[i+1].level());
+        else
+            fprintf(out, "L%d <-> Memory: ", _levels[i].level());
+        fprintf(out, "%ld bytes filled, %ld bytes written back, %lf bytes/instruction\n",
+                bytes_in, bytes_out, (double)(bytes_in + bytes_out) / _instruction_count);
+    }
+    if (_streaming_store_count > 0)
+    {
+        fprintf(out, "Streaming stores -> Memory: %ld stores, %ld coalesced, "
+                "%ld full-line and %ld partial writes, %ld bytes, %lf bytes/instruction\n",
+                _streaming_store_count, _wc_buffer.coalescedCount(),
+                _wc_buffer.fullDrainCount(), _wc_buffer.partialDrainCount(),
+                _wc_buffer.bytesDrained(), (double)_wc_buffer.bytesDrained() / _instruction_count);
+    }
+    fprintf(out, "\n");
+    if (_translation_enabled)
+    {
+        TLB *tlbs[] = { &_itlb, &_dtlb, &_stlb };
+        for (int i = 0; i < 3; ++i)
+        {
+            if (!tlbs[i]->enabled())
+                continue;
+            fprintf(out, "%s:-\n", tlbs[i]->name());
+            fprintf(out, "Miss ratio = %lf\n", tlbs[i]->missRate());
+            fprintf(out, "TLB hits = %ld\n", tlbs[i]->hitCount());
+            fprintf(out, "Misses per 1000 instructions = %lf\n",
+                    1000.0 * tlbs[i]->missCount() / _instruction_count);
+            fprintf(out, "\n");
+        }
+        fprintf(out, "Page walks = %ld\n", _walk_count);
+        fprintf(out, "Page walk memory accesses = %ld\n", _walk_accesses);
+        fprintf(out, "Pages touched = %lu (%d byte pages)\n",
+                _page_allocator.pagesMapped(), 1 << _page_allocator.pageBits());
+        fprintf(out, "Page table pages = %lu\n", _page_allocator.tablesAllocated());
+        if (_page_allocator.sharedFrames())
+            fprintf(out, "Pages sharing a frame (physical memory full) = %lu\n",
+                    _page_allocator.sharedFrames());
+        fprintf(out, "\n");
+    }
+}
+
+#endif // CACHE_MODEL_H
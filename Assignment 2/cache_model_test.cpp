@@ -0,0 +1,259 @@
+/*
+ *  Unit tests for the cache model in cache_model.h. Each test builds a small hierarchy
+ *  by hand, drives it with a few addresses and checks the resulting state and counters.
+ *  They do not need Pin. Run with: make cache_model_test.test
+ */
+
+#include "cache_model.h"
+
+static int test_count = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(EXIT_FAILURE); \
+        } \
+    } while (0)
+
+// Returns true if the line holding addr is present in the given level
+static bool resident(CacheHierarchy &h, int level_index, unsigned long addr)
+{
+    int set_no, line_no;
+    return h.level(level_index).probe(addr, set_no, line_no);
+}
+
+// 1KB direct-mapped L1 with 64 byte lines (16 sets) over an 8KB 4-way L2
+static void buildTwoLevels(CacheHierarchy &h, const char *rep_policy)
+{
+    h.addLevel(1, 64, 1, 1, rep_policy);
+    h.addLevel(8, 64, 4, 10, rep_policy);
+    h.setMemoryLatency(100);
+}
+
+// Addresses 1KB apart map to the same direct-mapped set and evict each other
+void testDirectMappedConflict()
+{
+    CacheHierarchy h;
+    buildTwoLevels(h, "LRU");
+
+    CHECK(h.read(0x1000) == 2);             // cold miss, served by memory
+    CHECK(h.read(0x1000) == 0);             // L1 hit
+    CHECK(h.read(0x1400) == 2);             // conflicts with 0x1000 in L1
+    CHECK(!resident(h, 0, 0x1000));
+    CHECK(resident(h, 1, 0x1000));
+    CHECK(h.read(0x1000) == 1);             // still in L2
+    CHECK(h.level(0).hitCount() == 1 && h.level(0).missCount() == 3);
+    CHECK(h.latency(0) == 1 && h.latency(1) == 10 && h.latency(2) == 100);
+    ++test_count;
+}
+
+// LRU evicts the least recently used line of a set
+void testLRUOrder()
+{
+    CacheHierarchy h;
+    h.addLevel(1, 64, 4, 1, "LRU");             // 4 sets of 4 lines, 256 bytes apart
+    h.setMemoryLatency(100);
+
+    unsigned long a[5] = { 0x0, 0x100, 0x200, 0x300, 0x400 };
+    for (int i = 0; i < 4; ++i)
+        h.read(a[i]);
+    h.read(a[0]);                               // a[1] is now the oldest
+    h.read(a[4]);
+    CHECK(resident(h, 0, a[0]));
+    CHECK(!resident(h, 0, a[1]));
+    CHECK(resident(h, 0, a[4]));
+    ++test_count;
+}
+
+// Evicting a line from L2 back-invalidates the copy held by L1 (inclusion), and dirty
+// data found in L1 is written back to memory
+void testBackInvalidation()
+{
+    CacheHierarchy h;
+    h.addLevel(1, 64, 4, 1, "LRU");
+    h.addLevel(1, 64, 1, 10, "LRU");            // direct-mapped L2 of the same size
+    h.setMemoryLatency(100);
+
+    h.write(0x0, 4);                            // dirty in L1, clean in L2
+    h.read(0x400);                              // same L2 set: evicts 0x0 from L2
+    CHECK(!resident(h, 0, 0x0));
+    CHECK(h.level(0).backInvalidationCount() == 1);
+    CHECK(h.level(1).dirtyWritebackCount() == 1);
+    CHECK(h.level(1).bytesOut() == 64);
+    ++test_count;
+}
+
+// Dirty lines evicted from a write-back L1 are written into L2, clean ones are dropped
+void testDirtyWriteback()
+{
+    CacheHierarchy h;
+    buildTwoLevels(h, "LRU");
+
+    h.write(0x0, 8);
+    h.read(0x400);                              // evicts the dirty line
+    h.read(0x800);                              // evicts the clean line
+    CHECK(h.level(0).dirtyWritebackCount() == 1);
+    CHECK(h.level(0).cleanEvictionCount() == 1);
+    CHECK(h.level(0).fillCount() == 3);
+    CHECK(h.level(1).hitCount() == 1);          // the writeback hit in L2
+    CHECK(h.level(0).bytesIn() == 3*64 && h.level(0).bytesOut() == 64);
+    ++test_count;
+}
+
+// A write-through, no-write-allocate L1 never holds dirty data and does not fill on
+// a write miss
+void testWriteThroughNoAllocate()
+{
+    CacheHierarchy h;
+    buildTwoLevels(h, "LRU");
+    h.level(0).setWritePolicy(true, false, 0, &h);
+
+    h.write(0x40, 4);                           // miss: goes around L1
+    CHECK(!resident(h, 0, 0x40));
+    CHECK(resident(h, 1, 0x40));
+    h.read(0x40);
+    h.write(0x40, 4);                           // hit: updates L1 and L2
+    int set_no, line_no;
+    CHECK(h.level(0).probe(0x40, set_no, line_no));
+    CHECK(!h.level(0).isDirtyLine(set_no, line_no));
+    CHECK(h.level(0).forwardedWriteCount() == 2);
+    CHECK(h.level(0).bytesOut() == 8);
+    ++test_count;
+}
+
+// A write buffer merges writes to the same line and drains them as one write
+void testWriteBufferCoalescing()
+{
+    CacheHierarchy h;
+    buildTwoLevels(h, "LRU");
+    h.level(0).setWritePolicy(true, false, 2, &h);
+    WriteBuffer *wb = h.level(0).writeBuffer();
+
+    for (int i = 0; i < 16; ++i)
+        h.write(0x80 + 4*i, 4);                 // fills one line, 4 bytes at a time
+    h.write(0x1000, 4);
+    CHECK(wb->writeCount() == 17 && wb->coalescedCount() == 15);
+    CHECK(h.level(1).hitCount() + h.level(1).missCount() == 0);
+    h.flushWriteBuffers();
+    CHECK(wb->fullDrainCount() == 1 && wb->partialDrainCount() == 1);
+    CHECK(wb->bytesDrained() == 68);
+    CHECK(h.level(1).missCount() == 2);
+    ++test_count;
+}
+
+// Pages are mapped on first touch, TLB hits avoid walks and a 4-level walk reads four
+// page table entries through the caches
+void testTranslation()
+{
+    CacheHierarchy h;
+    buildTwoLevels(h, "LRU");
+    h.enableTranslation(12, 16*K*K, 0);
+    h.dtlb().initialize("DTLB", 4, 4, 1, "LRU");
+    h.itlb().initialize("ITLB", 4, 4, 1, "LRU");
+
+    h.read(0x7f0000001000UL);
+    h.read(0x7f0000001008UL);                   // same page: DTLB hit
+    h.read(0x7f0000002000UL);
+    CHECK(h.walkCount() == 2 && h.walkAccesses() == 8);
+    CHECK(h.dtlb().hitCount() == 1 && h.dtlb().missCount() == 2);
+    CHECK(h.pageAllocator().pagesMapped() == 2);
+    CHECK(h.pageAllocator().tablesAllocated() == 4);    // both pages share every table
+    ++test_count;
+}
+
+// With page colouring a page keeps the colour of its virtual page number
+void testPageColouring()
+{
+    PageAllocator pa;
+    pa.initialize(12, 64*K*K, 8);
+    for (unsigned long vpn = 1000; vpn < 1100; ++vpn)
+        CHECK(pa.frameFor(vpn) % 8 == vpn % 8);
+    CHECK(pa.frameFor(1000) == pa.frameFor(1000));
+    pa.finalize();
+    ++test_count;
+}
+
+// Pages beyond the frames of physical memory (or of their colour) are counted as
+// sharing a frame
+void testFramesExhausted()
+{
+    PageAllocator pa;
+    pa.initialize(12, 64*K, 0);                 // 16 frames
+    for (unsigned long vpn = 0; vpn < 16; ++vpn)
+        pa.frameFor(vpn);
+    CHECK(pa.sharedFrames() == 0);
+    pa.frameFor(16);
+    CHECK(pa.sharedFrames() == 1);
+    pa.finalize();
+
+    pa.initialize(12, 64*K, 4);                 // 4 frames of each colour
+    for (unsigned long vpn = 0; vpn < 20; vpn += 4)
+        pa.frameFor(vpn);
+    CHECK(pa.sharedFrames() == 1);
+    pa.finalize();
+    ++test_count;
+}
+
+// A streaming store removes the line from the caches and is combined in the write
+// combining buffer instead of being allocated
+void testStreamingWrite()
+{
+    CacheHierarchy h;
+    buildTwoLevels(h, "LRU");
+    h.setWriteCombining(4);
+
+    h.write(0x200, 4);                          // dirty copy in L1
+    h.streamingWrite(0x200, 8);
+    h.streamingWrite(0x208, 8);
+    CHECK(!resident(h, 0, 0x200) && !resident(h, 1, 0x200));
+    CHECK(h.level(1).dirtyWritebackCount() == 1);
+    h.flushWriteBuffers();
+    CHECK(h.streamingStoreCount() == 2);
+    CHECK(h.writeCombiningBuffer().coalescedCount() == 1);
+    CHECK(h.writeCombiningBuffer().bytesDrained() == 16);
+    ++test_count;
+}
+
+// The configuration files shipped with the tool describe valid hierarchies
+void testReadConfig()
+{
+    CacheHierarchy h;
+    CHECK(h.readConfig("config/LRU_config.txt"));
+    CHECK(h.levelCount() > 0);
+    CHECK(h.readConfig("config/WT_config.txt", "RR"));
+    CHECK(h.level(0).writeThrough() && !h.level(0).writeAllocate());
+    CHECK(h.level(0).writeBuffer() != NULL);
+    CHECK(h.readConfig("config/TLB_config.txt"));
+    CHECK(h.translationEnabled() && h.dtlb().enabled());
+    CHECK(!h.readConfig("config/no_such_config.txt"));
+
+    // A physical memory size that is not a power of two is rejected
+    const char *bad_config = "physical_memory_test_config.txt";
+    FILE *f = fopen(bad_config, "w");
+    CHECK(f != NULL);
+    fprintf(f, "Levels = 1\n\n[Level 1]\nSize = 32KB\nAssociativity = 4\nBlock_size = 64bytes\n"
+            "Hit_Latency = 4\nReplacement_Policy = LRU\n\n[Main Memory]\nHit Latency = 200\n\n"
+            "[TLB]\nPage_Size = 4KB\nPhysical_Memory = 3000MB\nPage_Colors = 0\n");
+    fclose(f);
+    bool accepted = h.readConfig(bad_config);
+    remove(bad_config);
+    CHECK(!accepted);
+    ++test_count;
+}
+
+int main()
+{
+    testDirectMappedConflict();
+    testLRUOrder();
+    testBackInvalidation();
+    testDirtyWriteback();
+    testWriteThroughNoAllocate();
+    testWriteBufferCoalescing();
+    testTranslation();
+    testPageColouring();
+    testFramesExhausted();
+    testStreamingWrite();
+    testReadConfig();
+    printf("All %d cache model tests passed\n", test_count);
+    return EXIT_SUCCESS;
+}
@@ -1,86 +1,670 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <deque>
 #include <iostream>
 #include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <immintrin.h>
 
+// Tile sizes used by the blocked kernels, in elements. Rows of A and C are blocked by
+// i, the shared dimension by k and columns of B and C by j.
+struct Tiling {
+    size_t i, k, j;
+};
+
+static Tiling tiling = { 64, 256, 256 };
+
+/*******************************************************************************************
+ * STORAGE LAYOUTS
+ *
+ * A layout maps element (i, j) of an n x n matrix to its offset in the allocation.
+ * ld is the leading dimension the layout picked for n.
+*******************************************************************************************/
+
+// Rows one after the other, each ld >= n elements long. The padding breaks up the
+// power-of-two strides that make a column of the matrix map to only a few cache sets.
+struct RowMajor {
+    static const char *name() { return "rowmajor"; }
+    static size_t leadingDimension(size_t n, size_t pad) { return n + pad; }
+    static size_t allocation(size_t n, size_t ld) { return n * ld; }
+    static size_t offset(size_t i, size_t j, size_t ld) { return i*ld + j; }
+};
+
+// Square tiles of EDGE x EDGE elements stored contiguously, in row-major order of
+// tiles. ld is n rounded up to a whole number of tiles.
+struct TiledLayout {
+    static const size_t EDGE = 32;
+    static const char *name() { return "tiled"; }
+    static size_t leadingDimension(size_t n, size_t) { return (n + EDGE - 1) / EDGE * EDGE; }
+    static size_t allocation(size_t, size_t ld) { return ld * ld; }
+    static size_t offset(size_t i, size_t j, size_t ld) {
+        return ((i / EDGE)*ld + (j / EDGE)*EDGE)*EDGE + (i % EDGE)*EDGE + j % EDGE;
+    }
+};
+
+// Z-order: the bits of i and j are interleaved, so that every aligned power-of-two
+// block is contiguous. ld is n rounded up to a power of two.
+struct MortonLayout {
+    static const char *name() { return "morton"; }
+    static size_t leadingDimension(size_t n, size_t) {
+        size_t ld = 1;
+        while (ld < n)
+            ld *= 2;
+        return ld;
+    }
+    static size_t allocation(size_t, size_t ld) { return ld * ld; }
+    // Spreads the low 32 bits of x out to the even bit positions
+    static uint64_t spread(uint64_t x) {
+        x &= 0xFFFFFFFFULL;
+        x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+        x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+        x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        x = (x | (x << 2)) & 0x3333333333333333ULL;
+        x = (x | (x << 1)) & 0x5555555555555555ULL;
+        return x;
+    }
+    static size_t offset(size_t i, size_t j, size_t) { return (spread(i) << 1) | spread(j); }
+};
+
+// Products of small types are accumulated in a wider type, so int8 inputs give an
+// int32 result
+template <class T> struct Accumulator { typedef T type; };
+template <> struct Accumulator<int8_t> { typedef int32_t type; };
+
+/*******************************************************************************************
+ * MATRIX
+*******************************************************************************************/
+
+template <class T, class L = RowMajor>
 class Matrix {
     private:
-        int *_data;
+        T *_data;
         size_t _size;
-        
+        size_t _ld;
+        size_t _allocation;
+
+        // Matrices own their storage
+        Matrix(const Matrix&);
+        Matrix& operator=(const Matrix&);
+
+        template <class, class> friend class Matrix;
+        typedef typename Accumulator<T>::type Acc;
+        typedef Matrix<Acc, L> Result;
+
+        static void multiplyRecursive(Matrix& A, Matrix& B, Result& C, size_t i0, size_t k0, size_t j0,
+                size_t m, size_t k, size_t p);
+
     public:
-        Matrix(size_t);
+        Matrix(size_t, size_t pad = 0, bool huge_pages = false);
+        ~Matrix() { free(_data); }
         size_t size() { return _size; }
-        void fillRandomData();
-        void fillZeros();
+        size_t leadingDimension() { return _ld; }
+        T& at(size_t i, size_t j) { return _data[L::offset(i, j, _ld)]; }
+        const T& at(size_t i, size_t j) const { return _data[L::offset(i, j, _ld)]; }
+        void fillRandomData(unsigned int seed, size_t row_begin, size_t row_end);
+        void fillZeros(size_t row_begin, size_t row_end);
+        void fillZeros() { memset(_data, 0, _allocation*sizeof(T)); }
         void display();
-        static void multiply(Matrix&, Matrix&, Matrix&);
-         
+        unsigned long long checksum();
+        bool operator==(const Matrix&) const;
+
+        //Kernels computing C += A*B for rows [i0, i1) and columns [j0, j1) of C
+        static void multiply(Matrix&, Matrix&, Result&, size_t i0, size_t i1, size_t j0, size_t j1);
+        static void multiplyIKJ(Matrix&, Matrix&, Result&, size_t i0, size_t i1, size_t j0, size_t j1);
+        static void multiplyTransposed(Matrix&, Matrix&, Result&, size_t i0, size_t i1, size_t j0, size_t j1);
+        static void multiplyTiled(Matrix&, Matrix&, Result&, size_t i0, size_t i1, size_t j0, size_t j1);
+        static void multiplyAVX2(Matrix&, Matrix&, Result&, size_t i0, size_t i1, size_t j0, size_t j1);
+        static void multiplyCacheOblivious(Matrix&, Matrix&, Result&, size_t i0, size_t i1, size_t j0, size_t j1);
+        static void multiply(Matrix& A, Matrix& B, Result& C) {
+            multiply(A, B, C, 0, C._size, 0, C._size);
+        }
+
         //For printing
-        friend std::ostream& operator<<(std::ostream&, const Matrix&);
+        template <class U, class M> friend std::ostream& operator<<(std::ostream&, const Matrix<U, M>&);
 };
 
-Matrix::Matrix(size_t size) {
+// Allocates the storage aligned to a cache line, or to a 2MB huge page if huge_pages
+// is set, in which case the kernel is also asked to back it with huge pages. Does not
+// touch the elements, so that the pages are placed in memory by whichever thread
+// initializes them first.
+template <class T, class L>
+Matrix<T, L>::Matrix(size_t size, size_t pad, bool huge_pages) {
     _size = size;
-    _data = new int[_size*_size];
+    _ld = L::leadingDimension(_size, pad);
+    _allocation = L::allocation(_size, _ld);
+    size_t alignment = huge_pages ? 2*1024*1024 : 64;
+    size_t bytes = (_allocation*sizeof(T) + alignment - 1) / alignment * alignment;
+    void *data = NULL;
+    if (posix_memalign(&data, alignment, std::max(bytes, alignment)) != 0) {
+        std::cerr << "Cannot allocate a " << _size << "x" << _size << " matrix" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+#ifdef MADV_HUGEPAGE
+    if (huge_pages)
+        madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+    _data = (T *)data;
+}
+
+template <class T, class L>
+void Matrix<T, L>::fillZeros(size_t row_begin, size_t row_end) {
+    for (size_t i = row_begin; i < row_end; ++i) {
+        for (size_t j = 0; j < _size; ++j) {
+            at(i, j) = 0;
+        }
+    }
+}
+
+// Every element is a hash of the seed and its position, so the contents do not depend
+// on which thread fills which rows, the element type or the layout
+template <class T, class L>
+void Matrix<T, L>::fillRandomData(unsigned int seed, size_t row_begin, size_t row_end) {
+    for (size_t i = row_begin; i < row_end; ++i) {
+        for (size_t j = 0; j < _size; ++j) {
+            unsigned long long x = (seed + 1) * 0x9E3779B97F4A7C15ULL + i*_size + j;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+            at(i, j) = (T)((int)((x ^ (x >> 31)) % 32) - 16);
+        }
+    }
 }
 
-void Matrix::fillZeros() {
-    memset(_data, 0, _size*_size*sizeof(int));
+// Position weighted sum of the elements, so that a result with misplaced elements
+// does not match either. The elements are small integers in every type, so results of
+// different types and layouts have the same checksum.
+template <class T, class L>
+unsigned long long Matrix<T, L>::checksum() {
+    unsigned long long sum = 0;
+    for (size_t i = 0; i < _size; ++i) {
+        for (size_t j = 0; j < _size; ++j) {
+            sum = sum*31 + (unsigned int)(long long)at(i, j);
+        }
+    }
+    return sum;
 }
 
-void Matrix::fillRandomData() {
+template <class T, class L>
+bool Matrix<T, L>::operator==(const Matrix &B) const {
+    if (_size != B._size)
+        return false;
     for (size_t i = 0; i < _size; ++i) {
         for (size_t j = 0; j < _size; ++j) {
-            _data[i*_size + j] = (rand() % 32) - 16;
+            if (at(i, j) != B.at(i, j))
+                return false;
         }
     }
+    return true;
 }
 
-void Matrix::multiply(Matrix& A, Matrix& B, Matrix& C) {
+// Naive ijk order. The inner loop walks down a column of B.
+template <class T, class L>
+void Matrix<T, L>::multiply(Matrix& A, Matrix& B, Result& C, size_t i0, size_t i1, size_t j0, size_t j1) {
     size_t n = A._size;
-    for (size_t i = 0; i < n; ++i) {
-        for (size_t j = 0; j < n; ++j) {
+    for (size_t i = i0; i < i1; ++i) {
+        for (size_t j = j0; j < j1; ++j) {
             for (size_t k = 0; k < n; ++k) {
-                C._data[i*n + j] += A._data[i*n + k] * B._data[k*n + j];     
+                C.at(i, j) += (Acc)A.at(i, k) * B.at(k, j);
             }
         }
     }
 }
 
-std::ostream& operator<<(std::ostream& out, const Matrix &A) {
+// ikj order. The inner loop streams through a row of B and a row of C.
+template <class T, class L>
+void Matrix<T, L>::multiplyIKJ(Matrix& A, Matrix& B, Result& C, size_t i0, size_t i1, size_t j0, size_t j1) {
+    size_t n = A._size;
+    for (size_t i = i0; i < i1; ++i) {
+        for (size_t k = 0; k < n; ++k) {
+            Acc a = A.at(i, k);
+            for (size_t j = j0; j < j1; ++j) {
+                C.at(i, j) += a * B.at(k, j);
+            }
+        }
+    }
+}
+
+// Transposes the columns of B that are needed first, so that every element of C is a
+// dot product of two rows. The transpose is part of the timed work.
+template <class T, class L>
+void Matrix<T, L>::multiplyTransposed(Matrix& A, Matrix& B, Result& C, size_t i0, size_t i1, size_t j0, size_t j1) {
+    size_t n = A._size;
+    T *Bt = new T[(j1 - j0)*n];
+    for (size_t k = 0; k < n; ++k) {
+        for (size_t j = j0; j < j1; ++j) {
+            Bt[(j - j0)*n + k] = B.at(k, j);
+        }
+    }
+    for (size_t i = i0; i < i1; ++i) {
+        for (size_t j = j0; j < j1; ++j) {
+            Acc sum = 0;
+            for (size_t k = 0; k < n; ++k) {
+                sum += (Acc)A.at(i, k) * Bt[(j - j0)*n + k];
+            }
+            C.at(i, j) += sum;
+        }
+    }
+    delete[] Bt;
+}
+
+// ikj order over tiles of tiling.i x tiling.k of A and tiling.k x tiling.j of B, so
+// that the tiles being worked on stay in cache
+template <class T, class L>
+void Matrix<T, L>::multiplyTiled(Matrix& A, Matrix& B, Result& C, size_t i0, size_t i1, size_t j0, size_t j1) {
+    size_t n = A._size;
+    for (size_t ii = i0; ii < i1; ii += tiling.i) {
+        size_t i_end = std::min(ii + tiling.i, i1);
+        for (size_t k0 = 0; k0 < n; k0 += tiling.k) {
+            size_t k_end = std::min(k0 + tiling.k, n);
+            for (size_t jj = j0; jj < j1; jj += tiling.j) {
+                size_t j_end = std::min(jj + tiling.j, j1);
+                for (size_t i = ii; i < i_end; ++i) {
+                    for (size_t k = k0; k < k_end; ++k) {
+                        Acc a = A.at(i, k);
+                        for (size_t j = jj; j < j_end; ++j) {
+                            C.at(i, j) += a * B.at(k, j);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// The AVX2 kernel only exists for row-major int32 matrices
+template <class T, class L> struct AVX2Kernel {
+    static bool supported() { return false; }
+    static void multiply(Matrix<T, L>&, Matrix<T, L>&, Matrix<typename Accumulator<T>::type, L>&,
+            size_t, size_t, size_t, size_t) {}
+};
+
+// Computes a 4x16 block of C in eight AVX2 registers. Each step of k broadcasts four
+// elements of a column of A and multiplies them into two vectors of a row of B.
+__attribute__((target("avx2")))
+static void microKernel4x16(const int *A, const int *B, int *C, size_t ld, size_t k0, size_t k_end) {
+    __m256i c00 = _mm256_loadu_si256((const __m256i *)&C[0*ld]);
+    __m256i c01 = _mm256_loadu_si256((const __m256i *)&C[0*ld + 8]);
+    __m256i c10 = _mm256_loadu_si256((const __m256i *)&C[1*ld]);
+    __m256i c11 = _mm256_loadu_si256((const __m256i *)&C[1*ld + 8]);
+    __m256i c20 = _mm256_loadu_si256((const __m256i *)&C[2*ld]);
+    __m256i c21 = _mm256_loadu_si256((const __m256i *)&C[2*ld + 8]);
+    __m256i c30 = _mm256_loadu_si256((const __m256i *)&C[3*ld]);
+    __m256i c31 = _mm256_loadu_si256((const __m256i *)&C[3*ld + 8]);
+    for (size_t k = k0; k < k_end; ++k) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)&B[k*ld]);
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)&B[k*ld + 8]);
+        __m256i a;
+        a = _mm256_set1_epi32(A[0*ld + k]);
+        c00 = _mm256_add_epi32(c00, _mm256_mullo_epi32(a, b0));
+        c01 = _mm256_add_epi32(c01, _mm256_mullo_epi32(a, b1));
+        a = _mm256_set1_epi32(A[1*ld + k]);
+        c10 = _mm256_add_epi32(c10, _mm256_mullo_epi32(a, b0));
+        c11 = _mm256_add_epi32(c11, _mm256_mullo_epi32(a, b1));
+        a = _mm256_set1_epi32(A[2*ld + k]);
+        c20 = _mm256_add_epi32(c20, _mm256_mullo_epi32(a, b0));
+        c21 = _mm256_add_epi32(c21, _mm256_mullo_epi32(a, b1));
+        a = _mm256_set1_epi32(A[3*ld + k]);
+        c30 = _mm256_add_epi32(c30, _mm256_mullo_epi32(a, b0));
+        c31 = _mm256_add_epi32(c31, _mm256_mullo_epi32(a, b1));
+    }
+    _mm256_storeu_si256((__m256i *)&C[0*ld], c00);
+    _mm256_storeu_si256((__m256i *)&C[0*ld + 8], c01);
+    _mm256_storeu_si256((__m256i *)&C[1*ld], c10);
+    _mm256_storeu_si256((__m256i *)&C[1*ld + 8], c11);
+    _mm256_storeu_si256((__m256i *)&C[2*ld], c20);
+    _mm256_storeu_si256((__m256i *)&C[2*ld + 8], c21);
+    _mm256_storeu_si256((__m256i *)&C[3*ld], c30);
+    _mm256_storeu_si256((__m256i *)&C[3*ld + 8], c31);
+}
+
+// Register-blocked kernel. Tiles of tiling.k along the shared dimension keep a panel
+// of B in cache while 4x16 blocks of C are computed by the micro-kernel. Rows and
+// columns left over at the edges are done in scalar ikj order.
+template <> struct AVX2Kernel<int32_t, RowMajor> {
+    static bool supported() { return __builtin_cpu_supports("avx2"); }
+    static void multiply(Matrix<int32_t>& A, Matrix<int32_t>& B, Matrix<int32_t>& C,
+            size_t i0, size_t i1, size_t j0, size_t j1) {
+        size_t n = A.size(), ld = A.leadingDimension();
+        size_t i4 = i1 - (i1 - i0) % 4, j16 = j1 - (j1 - j0) % 16;
+        for (size_t k0 = 0; k0 < n; k0 += tiling.k) {
+            size_t k_end = std::min(k0 + tiling.k, n);
+            for (size_t jj = j0; jj < j16; jj += 16) {
+                for (size_t ii = i0; ii < i4; ii += 4) {
+                    microKernel4x16(&A.at(ii, 0), &B.at(0, jj), &C.at(ii, jj), ld, k0, k_end);
+                }
+            }
+            for (size_t i = i0; i < i1; ++i) {
+                size_t j_start = (i < i4) ? j16 : j0;
+                for (size_t k = k0; k < k_end; ++k) {
+                    int a = A.at(i, k);
+                    for (size_t j = j_start; j < j1; ++j) {
+                        C.at(i, j) += a * B.at(k, j);
+                    }
+                }
+            }
+        }
+    }
+};
+
+template <class T, class L>
+void Matrix<T, L>::multiplyAVX2(Matrix& A, Matrix& B, Result& C, size_t i0, size_t i1, size_t j0, size_t j1) {
+    AVX2Kernel<T, L>::multiply(A, B, C, i0, i1, j0, j1);
+}
+
+// C (m x p) += A (m x k) * B (k x p), for the blocks starting at row i0 and column k0
+// of A, row k0 and column j0 of B and row i0 and column j0 of C. Halves the largest of
+// the three dimensions until the blocks are small enough to fit in any cache, without
+// knowing the cache sizes.
+template <class T, class L>
+void Matrix<T, L>::multiplyRecursive(Matrix& A, Matrix& B, Result& C, size_t i0, size_t k0, size_t j0,
+        size_t m, size_t k, size_t p) {
+    if (m*k + k*p + m*p <= 3*32*32) {
+        for (size_t i = i0; i < i0 + m; ++i) {
+            for (size_t kk = k0; kk < k0 + k; ++kk) {
+                Acc a = A.at(i, kk);
+                for (size_t j = j0; j < j0 + p; ++j) {
+                    C.at(i, j) += a * B.at(kk, j);
+                }
+            }
+        }
+    } else if (m >= k && m >= p) {
+        multiplyRecursive(A, B, C, i0, k0, j0, m/2, k, p);
+        multiplyRecursive(A, B, C, i0 + m/2, k0, j0, m - m/2, k, p);
+    } else if (p >= k) {
+        multiplyRecursive(A, B, C, i0, k0, j0, m, k, p/2);
+        multiplyRecursive(A, B, C, i0, k0, j0 + p/2, m, k, p - p/2);
+    } else {
+        multiplyRecursive(A, B, C, i0, k0, j0, m, k/2, p);
+        multiplyRecursive(A, B, C, i0, k0 + k/2, j0, m, k - k/2, p);
+    }
+}
+
+template <class T, class L>
+void Matrix<T, L>::multiplyCacheOblivious(Matrix& A, Matrix& B, Result& C, size_t i0, size_t i1, size_t j0, size_t j1) {
+    multiplyRecursive(A, B, C, i0, 0, j0, i1 - i0, A._size, j1 - j0);
+}
+
+template <class T, class L>
+std::ostream& operator<<(std::ostream& out, const Matrix<T, L> &A) {
     for (size_t i = 0; i < A._size; ++i) {
         for (size_t j = 0; j < A._size; ++j) {
             out.width(6);
-            out << A._data[i*A._size + j] << " ";
+            out << (long long)A.at(i, j) << " ";
         }
         out << std::endl;
     }
     return out;
 }
 
-int main(int argc, char *argv[]) {
+double seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-    if (argc < 2) {
-        std::cout << "USAGE:- " << argv[0] << " <MATRIX_SIZE>" << std::endl;
-        return EXIT_FAILURE;
-    } 
+/*******************************************************************************************
+ * PARALLEL EXECUTION
+ *
+ * C is cut into work units: blocks of tiling.i rows, blocks of tiling.j columns, or
+ * tiling.i x tiling.j tiles. Every thread starts with a contiguous share of the units
+ * in its own queue, works from the front of it and, once it runs dry, steals from the
+ * back of the other queues.
+*******************************************************************************************/
 
-    //Take matrix size as input
+enum Partition { ROW_BLOCKS, COLUMN_BLOCKS, TILES };
+
+struct WorkUnit {
+    size_t i0, i1, j0, j1;
+};
+
+struct ThreadStats {
+    long units;
+    long stolen;
+    double busy;    // time spent in the kernel
+    double finish;  // time from the start until the thread ran out of work
+};
+
+class WorkQueue {
+    std::mutex _lock;
+    std::deque<int> _units;
+
+    public:
+    void push(int unit) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _units.push_back(unit);
+    }
+    // The owner takes units from the front
+    bool pop(int &unit) {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_units.empty())
+            return false;
+        unit = _units.front();
+        _units.pop_front();
+        return true;
+    }
+    // Thieves take them from the back, away from where the owner is working
+    bool steal(int &unit) {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_units.empty())
+            return false;
+        unit = _units.back();
+        _units.pop_back();
+        return true;
+    }
+};
+
+std::vector<WorkUnit> partition(size_t n, Partition kind) {
+    size_t row_step = (kind == COLUMN_BLOCKS) ? n : tiling.i;
+    size_t col_step = (kind == ROW_BLOCKS) ? n : tiling.j;
+    std::vector<WorkUnit> units;
+    for (size_t i0 = 0; i0 < n; i0 += row_step) {
+        for (size_t j0 = 0; j0 < n; j0 += col_step) {
+            WorkUnit unit = { i0, std::min(i0 + row_step, n), j0, std::min(j0 + col_step, n) };
+            units.push_back(unit);
+        }
+    }
+    return units;
+}
+
+// Rows [begin, end) of n that thread t of thread_count owns initially
+static size_t shareBegin(size_t n, int t, int thread_count) {
+    return n * t / thread_count;
+}
+
+// Each thread fills the rows it will mostly work on, so that with a first-touch page
+// placement policy those pages end up on its own NUMA node
+template <class T, class L>
+void parallelInitialize(Matrix<T, L>& A, Matrix<T, L>& B, Matrix<typename Accumulator<T>::type, L>& C,
+        unsigned int seed, int thread_count) {
+    std::vector<std::thread> threads;
+    size_t n = A.size();
+    for (int t = 0; t < thread_count; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            size_t begin = shareBegin(n, t, thread_count), end = shareBegin(n, t+1, thread_count);
+            A.fillRandomData(seed, begin, end);
+            B.fillRandomData(seed + 1, begin, end);
+            C.fillZeros(begin, end);
+        }));
+    }
+    for (int t = 0; t < thread_count; ++t)
+        threads[t].join();
+}
+
+// Runs kernel over all the units with thread_count threads. Returns the elapsed time.
+template <class T, class L, class Kernel>
+double parallelMultiply(Kernel kernel, Matrix<T, L>& A, Matrix<T, L>& B,
+        Matrix<typename Accumulator<T>::type, L>& C, const std::vector<WorkUnit> &units,
+        int thread_count, std::vector<ThreadStats> &stats) {
+    int unit_count = units.size();
+    std::vector<WorkQueue> queues(thread_count);
+    for (int t = 0; t < thread_count; ++t) {
+        for (int u = shareBegin(unit_count, t, thread_count); u < (int)shareBegin(unit_count, t+1, thread_count); ++u)
+            queues[t].push(u);
+    }
+    stats.assign(thread_count, ThreadStats());
+
+    std::atomic<int> remaining(unit_count);
+    std::vector<std::thread> threads;
+    double start = seconds();
+    for (int t = 0; t < thread_count; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            ThreadStats &ts = stats[t];
+            ts.units = ts.stolen = 0;
+            ts.busy = 0;
+            while (remaining.load() > 0) {
+                int u;
+                bool found = queues[t].pop(u);
+                for (int v = 1; !found && v < thread_count; ++v) {
+                    found = queues[(t + v) % thread_count].steal(u);
+                    ts.stolen += found;
+                }
+                if (!found)
+                    break;
+                double unit_start = seconds();
+                kernel(A, B, C, units[u].i0, units[u].i1, units[u].j0, units[u].j1);
+                ts.busy += seconds() - unit_start;
+                ts.units++;
+                remaining--;
+            }
+            ts.finish = seconds() - start;
+        }));
+    }
+    for (int t = 0; t < thread_count; ++t)
+        threads[t].join();
+    return seconds() - start;
+}
+
+/*******************************************************************************************
+ * TIMING HARNESS
+*******************************************************************************************/
+
+static const char *kernel_names[] = { "naive", "ikj", "transposed", "tiled", "avx2", "recursive" };
+static const int kernel_count = sizeof(kernel_names) / sizeof(kernel_names[0]);
+
+static const char *partition_names[] = { "rows", "cols", "tiles" };
+static const char *type_names[] = { "int32", "int8", "float", "double" };
+static const char *layout_names[] = { "rowmajor", "tiled", "morton" };
+
+struct Options {
     int n;
-    n = atoi(argv[1]);
+    int first_kernel, last_kernel;
+    int repetitions;
+    int thread_count;
+    Partition kind;
+    unsigned int seed;
+    bool verify;
+    long pad;           // elements added to each row, -1 to pad only power-of-two strides
+    bool huge_pages;
+};
+
+// Runs the selected kernels on matrices of element type T stored in layout L. Returns
+// false if a result did not match the naive kernel.
+template <class T, class L>
+bool run(const Options &opt, const char *type_name) {
+    typedef Matrix<T, L> Input;
+    typedef Matrix<typename Accumulator<T>::type, L> Result;
+    typedef void (*BlockKernel)(Input&, Input&, Result&, size_t, size_t, size_t, size_t);
+    BlockKernel kernels[] = {
+        Input::multiply, Input::multiplyIKJ, Input::multiplyTransposed,
+        Input::multiplyTiled, Input::multiplyAVX2, Input::multiplyCacheOblivious,
+    };
+    int n = opt.n;
+
+    // Automatic padding adds a cache line to rows whose length is a multiple of 256
+    // bytes, since those rows make a column fall into a fraction of the cache sets
+    size_t pad = opt.pad;
+    if (opt.pad < 0)
+        pad = (n * sizeof(T)) % 256 == 0 ? 64 / sizeof(T) : 0;
 
     //Fill two matrices randomly
-    srand(time(NULL));
-    Matrix A(n), B(n); 
-    A.fillRandomData();
-    B.fillRandomData();
-    
-    //Multiply the two matrices
-    Matrix C(n);
-    C.fillZeros();
-    Matrix::multiply(A, B, C);
+    Input A(n, pad, opt.huge_pages), B(n, pad, opt.huge_pages);
+    Result C(n, pad, opt.huge_pages);
+    if (opt.thread_count > 1) {
+        parallelInitialize(A, B, C, opt.seed, opt.thread_count);
+    } else {
+        A.fillRandomData(opt.seed, 0, n);
+        B.fillRandomData(opt.seed + 1, 0, n);
+    }
+
+    //Result of the naive kernel, to check the others against
+    Result reference(n, pad);
+    if (opt.verify) {
+        reference.fillZeros();
+        Input::multiply(A, B, reference);
+    }
+
+    std::vector<WorkUnit> units = partition(n, opt.kind);
+    std::vector<ThreadStats> stats, best_stats;
+
+    //Multiply the two matrices with every selected kernel
+    bool all_correct = true;
+    printf("%s %s matrices, leading dimension %zu", type_name, L::name(), A.leadingDimension());
+    if (opt.thread_count > 1) {
+        printf(", %d threads, %s partitioning, %d work units",
+                opt.thread_count, partition_names[opt.kind], (int)units.size());
+    }
+    printf("\n");
+    printf("%-12s %6s %10s %10s %18s", "kernel", "size", "seconds", "GFLOP/s", "checksum");
+    printf("%s%s\n", opt.thread_count > 1 ? "  speedup" : "", opt.verify ? "  verified" : "");
+    for (int kernel = opt.first_kernel; kernel <= opt.last_kernel; ++kernel) {
+        BlockKernel multiply = kernels[kernel];
+        if (multiply == Input::multiplyAVX2 && !AVX2Kernel<T, L>::supported()) {
+            printf("%-12s %6d  skipped, needs int32 row-major matrices and an AVX2 CPU\n",
+                    kernel_names[kernel], n);
+            continue;
+        }
+
+        // Best of the repetitions, each starting from a zero C. With several threads
+        // the same kernel is also timed on one thread, which the speedup is relative to.
+        double best = std::numeric_limits<double>::max();
+        double serial = std::numeric_limits<double>::max();
+        for (int r = 0; r < opt.repetitions; ++r) {
+            if (opt.thread_count > 1) {
+                C.fillZeros();
+                double start = seconds();
+                multiply(A, B, C, 0, n, 0, n);
+                serial = std::min(serial, seconds() - start);
+            }
+            C.fillZeros();
+            double elapsed;
+            if (opt.thread_count > 1) {
+                elapsed = parallelMultiply(multiply, A, B, C, units, opt.thread_count, stats);
+            } else {
+                double start = seconds();
+                multiply(A, B, C, 0, n, 0, n);
+                elapsed = seconds() - start;
+            }
+            if (elapsed < best) {
+                best = elapsed;
+                best_stats = stats;
+            }
+        }
+
+        // One multiply and one add per inner iteration
+        double gflops = 2.0 * n * n * n / best * 1e-9;
+        printf("%-12s %6d %10.6f %10.3f %18llx", kernel_names[kernel], n, best, gflops, C.checksum());
+        if (opt.thread_count > 1)
+            printf("  %7.2f", serial / best);
+        if (opt.verify) {
+            bool correct = C == reference;
+            all_correct = all_correct && correct;
+            printf("  %s", correct ? "yes" : "NO");
+        }
+        printf("\n");
+        for (size_t t = 0; t < best_stats.size(); ++t) {
+            printf("    thread %2d: %10.6f s finish, %10.6f s busy, %5ld units, %5ld stolen\n",
+                    (int)t, best_stats[t].finish, best_stats[t].busy,
+                    best_stats[t].units, best_stats[t].stolen);
+        }
+    }
 
 #ifdef DEBUG
     std::cout << "Matrix A = " << std::endl << A << std::endl;
@@ -88,5 +672,119 @@ int main(int argc, char *argv[]) {
     std::cout << "Matrix C = " << std::endl << C << std::endl;
 #endif
 
-    return EXIT_SUCCESS;
+    return all_correct;
+}
+
+template <class T>
+bool runLayout(const Options &opt, int layout, const char *type_name) {
+    switch (layout) {
+        case 1: return run<T, TiledLayout>(opt, type_name);
+        case 2: return run<T, MortonLayout>(opt, type_name);
+        default: return run<T, RowMajor>(opt, type_name);
+    }
+}
+
+// Index of name in names, or -1
+static int lookup(const char *name, const char **names, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (strcmp(name, names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+void usage(const char *prog) {
+    std::cout << "USAGE:- " << prog << " [-k kernel|all] [-b tile_i[,tile_k[,tile_j]]]"
+        << " [-t threads] [-p rows|cols|tiles] [-d int32|int8|float|double]"
+        << " [-l rowmajor|tiled|morton] [-P pad|auto] [-H] [-r repetitions] [-s seed] [-v]"
+        << " <MATRIX_SIZE>" << std::endl;
+    std::cout << "Kernels:";
+    for (int i = 0; i < kernel_count; ++i)
+        std::cout << " " << kernel_names[i];
+    std::cout << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+
+    Options options;
+    options.repetitions = 1;
+    options.thread_count = 1;
+    options.kind = TILES;
+    options.seed = time(NULL);
+    options.verify = false;
+    options.pad = 0;
+    options.huge_pages = false;
+    const char *kernel_name = "naive";
+    int type = 0, layout = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "k:b:t:p:d:l:P:Hr:s:v")) != -1) {
+        int p;
+        switch (opt) {
+            case 'k': kernel_name = optarg; break;
+            case 'b': {
+                // A single size applies to every dimension
+                unsigned long ti = 0, tk = 0, tj = 0;
+                int nargs = sscanf(optarg, "%lu,%lu,%lu", &ti, &tk, &tj);
+                tiling.i = ti;
+                tiling.k = (nargs >= 2) ? tk : ti;
+                tiling.j = (nargs >= 3) ? tj : tiling.k;
+                break;
+            }
+            case 't': options.thread_count = atoi(optarg); break;
+            case 'p':
+                if ((p = lookup(optarg, partition_names, 3)) < 0) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                options.kind = (Partition)p;
+                break;
+            case 'd':
+                if ((type = lookup(optarg, type_names, 4)) < 0) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'l':
+                if ((layout = lookup(optarg, layout_names, 3)) < 0) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'P': options.pad = strcmp(optarg, "auto") == 0 ? -1 : atol(optarg); break;
+            case 'H': options.huge_pages = true; break;
+            case 'r': options.repetitions = atoi(optarg); break;
+            case 's': options.seed = strtoul(optarg, NULL, 0); break;
+            case 'v': options.verify = true; break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc || options.repetitions < 1 || options.thread_count < 1
+            || tiling.i == 0 || tiling.k == 0 || tiling.j == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    //Take matrix size as input
+    options.n = atoi(argv[optind]);
+
+    options.first_kernel = 0;
+    options.last_kernel = kernel_count - 1;
+    if (strcmp(kernel_name, "all") != 0) {
+        options.first_kernel = options.last_kernel = lookup(kernel_name, kernel_names, kernel_count);
+        if (options.first_kernel < 0) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    bool correct;
+    switch (type) {
+        case 1: correct = runLayout<int8_t>(options, layout, type_names[type]); break;
+        case 2: correct = runLayout<float>(options, layout, type_names[type]); break;
+        case 3: correct = runLayout<double>(options, layout, type_names[type]); break;
+        default: correct = runLayout<int32_t>(options, layout, type_names[type]); break;
+    }
+
+    return correct ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,22 @@
+/*
+ *  Assembles a program in the text format read by outoforder into the binary format,
+ *  which outoforder maps and decodes as it fetches instead of parsing the whole file.
+ *  USAGE:- ./assemble input.txt output.bin
+ */
+
+#include "program.hpp"
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "USAGE:- " << argv[0] << " input_file output_file" << std::endl;
+        return 1;
+    }
+    std::vector<instruction> program;
+    fetchDecodeInstructions(argv[1], program);
+    if (!writeProgram(argv[2], program)) {
+        std::cerr << "Cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+    std::cout << program.size() << " instructions written to " << argv[2] << std::endl;
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+// Branch direction predictors and the branch target buffer of the front end.
+// A predictor is asked for a direction when a branch is fetched and trained when it
+// commits, both times with the global history that was current at fetch.
+
+class BranchPredictor {
+    public:
+    virtual ~BranchPredictor() {}
+    virtual bool predict(unsigned pc, uint64_t history) = 0;
+    virtual void update(unsigned pc, uint64_t history, bool taken) = 0;
+};
+
+// Moves a saturating counter in [lo, hi] towards the outcome
+template <typename T>
+void trainCounter(T &counter, bool taken, int lo, int hi) {
+    if (taken && counter < hi)
+        counter++;
+    else if (!taken && counter > lo)
+        counter--;
+}
+
+// Table of 2-bit counters indexed by the branch address
+class BimodalPredictor : public BranchPredictor {
+    std::vector<uint8_t> _counters;
+    unsigned _mask;
+
+    public:
+    BimodalPredictor(unsigned index_bits)
+        : _counters(1u << index_bits, 1), _mask((1u << index_bits) - 1) {}
+    bool predict(unsigned pc, uint64_t) {
+        return _counters[pc & _mask] >= 2;
+    }
+    void update(unsigned pc, uint64_t, bool taken) {
+        trainCounter(_counters[pc & _mask], taken, 0, 3);
+    }
+};
+
+// Table of 2-bit counters indexed by the branch address XORed with the global history
+class GSharePredictor : public BranchPredictor {
+    std::vector<uint8_t> _counters;
+    unsigned _mask;
+
+    unsigned index(unsigned pc, uint64_t history) {
+        return (pc ^ history) & _mask;
+    }
+
+    public:
+    GSharePredictor(unsigned index_bits)
+        : _counters(1u << index_bits, 1), _mask((1u << index_bits) - 1) {}
+    bool predict(unsigned pc, uint64_t history) {
+        return _counters[index(pc, history)] >= 2;
+    }
+    void update(unsigned pc, uint64_t history, bool taken) {
+        trainCounter(_counters[index(pc, history)], taken, 0, 3);
+    }
+};
+
+// Small TAGE: a bimodal base predictor and four tagged tables using geometrically
+// longer histories. The longest matching table provides the prediction. On a
+// misprediction an entry is allocated in a longer table, if one has an entry that
+// is no longer useful.
+class TagePredictor : public BranchPredictor {
+    static const int TABLES = 4;
+    static const int TAG_BITS = 8;
+    struct entry {
+        uint16_t tag = 0;
+        int8_t counter = 0;     // 3-bit signed, taken if >= 0
+        uint8_t useful = 0;     // 2-bit
+    };
+    BimodalPredictor _base;
+    std::vector<entry> _tables[TABLES];
+    unsigned _bits;             // index bits of each tagged table
+    unsigned long _updates = 0;
+
+    static unsigned historyLength(int t) {
+        static const unsigned lengths[TABLES] = { 5, 12, 26, 54 };
+        return lengths[t];
+    }
+    // XOR of the newest len bits of history taken bits at a time
+    static unsigned fold(uint64_t history, unsigned len, unsigned bits) {
+        if (len < 64)
+            history &= (1ULL << len) - 1;
+        unsigned folded = 0;
+        for (; history; history >>= bits)
+            folded ^= history & ((1u << bits) - 1);
+        return folded;
+    }
+    unsigned index(int t, unsigned pc, uint64_t history) {
+        return (pc ^ (pc >> _bits) ^ fold(history, historyLength(t), _bits)) & ((1u << _bits) - 1);
+    }
+    unsigned tag(int t, unsigned pc, uint64_t history) {
+        return (pc ^ fold(history, historyLength(t), TAG_BITS)
+                ^ (fold(history, historyLength(t), TAG_BITS - 1) << 1)) & ((1u << TAG_BITS) - 1);
+    }
+    // Longest table with a matching entry below table limit, or -1 if there is none
+    int provider(unsigned pc, uint64_t history, int limit) {
+        for (int t = limit - 1; t >= 0; --t)
+            if (_tables[t][index(t, pc, history)].tag == tag(t, pc, history))
+                return t;
+        return -1;
+    }
+    bool prediction(int t, unsigned pc, uint64_t history) {
+        if (t < 0)
+            return _base.predict(pc, history);
+        return _tables[t][index(t, pc, history)].counter >= 0;
+    }
+
+    public:
+    TagePredictor(unsigned index_bits) : _base(index_bits), _bits(index_bits > 2 ? index_bits - 2 : 1) {
+        for (int t = 0; t < TABLES; ++t)
+            _tables[t].resize(1u << _bits);
+    }
+    bool predict(unsigned pc, uint64_t history) {
+        return prediction(provider(pc, history, TABLES), pc, history);
+    }
+    void update(unsigned pc, uint64_t history, bool taken) {
+        int p = provider(pc, history, TABLES);
+        bool predicted = prediction(p, pc, history);
+        if (p >= 0) {
+            entry &e = _tables[p][index(p, pc, history)];
+            bool alternate = prediction(provider(pc, history, p), pc, history);
+            if (predicted != alternate)
+                trainCounter(e.useful, predicted == taken, 0, 3);
+            trainCounter(e.counter, taken, -4, 3);
+        } else {
+            _base.update(pc, history, taken);
+        }
+
+        if (predicted != taken && p < TABLES - 1) {
+            bool allocated = false;
+            for (int t = p + 1; t < TABLES && !allocated; ++t) {
+                entry &e = _tables[t][index(t, pc, history)];
+                if (e.useful == 0) {
+                    e.tag = tag(t, pc, history);
+                    e.counter = taken ? 0 : -1;
+                    allocated = true;
+                }
+            }
+            if (!allocated)
+                for (int t = p + 1; t < TABLES; ++t)
+                    trainCounter(_tables[t][index(t, pc, history)].useful, false, 0, 3);
+        }
+        // Age the useful bits now and then so that stale entries can be replaced
+        if (++_updates % (1u << 16) == 0)
+            for (int t = 0; t < TABLES; ++t)
+                for (entry &e : _tables[t])
+                    e.useful >>= 1;
+    }
+};
+
+// Returns the predictor of the given name, or NULL if there is no such predictor
+BranchPredictor* makePredictor(const std::string &name, unsigned index_bits) {
+    if (name == "bimodal") return new BimodalPredictor(index_bits);
+    if (name == "gshare")  return new GSharePredictor(index_bits);
+    if (name == "tage")    return new TagePredictor(index_bits);
+    return NULL;
+}
+
+// Direct-mapped branch target buffer. Fetch needs a hit to redirect to the target of a
+// taken branch in the same cycle; taken branches are entered when they commit.
+class BranchTargetBuffer {
+    struct entry {
+        bool valid = false;
+        unsigned pc = 0;
+        unsigned target = 0;
+    };
+    std::vector<entry> _entries;
+
+    public:
+    void setSize(size_t sz) {
+        _entries.assign(sz, entry());
+    }
+    bool lookup(unsigned pc, unsigned target) const {
+        const entry &e = _entries[pc % _entries.size()];
+        return e.valid && e.pc == pc && e.target == target;
+    }
+    void insert(unsigned pc, unsigned target) {
+        entry &e = _entries[pc % _entries.size()];
+        e.valid = true;
+        e.pc = pc;
+        e.target = target;
+    }
+};
@@ -0,0 +1,91 @@
+/*
+ *  Generates a synthetic program for outoforder, in the text format or, with -b, the
+ *  binary format. The mix of instructions, the distances of their dependences, the
+ *  memory footprint and the rate at which loads read recently stored addresses are set
+ *  by the options, and a seed always gives the same program.
+ *  USAGE:- ./generate [-b] [-n COUNT] [-m ALU:MUL:DIV:LD:ST] [-d DISTANCE] [-f WORDS]
+ *          [-a ALIAS_PERCENT] [-s SEED] output_file
+ */
+
+#include "program.hpp"
+#include "synthetic.hpp"
+
+void usage(const char *prog) {
+    synthetic_params defaults;
+    std::cerr << "USAGE:- " << prog << " [-b] [-n COUNT] [-m ALU:MUL:DIV:LD:ST] [-d DISTANCE] [-f WORDS]"
+        << " [-a ALIAS_PERCENT] [-s SEED] output_file" << std::endl
+        << "  -b                   write the binary format" << std::endl
+        << "  -n COUNT             instructions (default: " << defaults.count << ")" << std::endl
+        << "  -m ALU:MUL:DIV:LD:ST weights of the instruction classes (default: "
+        << defaults.mix[0] << ":" << defaults.mix[1] << ":" << defaults.mix[2] << ":"
+        << defaults.mix[3] << ":" << defaults.mix[4] << ")" << std::endl
+        << "  -d DISTANCE          dependence distances, fixed:N, uniform:MIN:MAX or geometric:MEAN"
+        << " (default: geometric:" << defaults.distance.mean << ")" << std::endl
+        << "  -f WORDS             data memory footprint (default: " << defaults.footprint << ")" << std::endl
+        << "  -a ALIAS_PERCENT     loads reading an address of a recent store (default: "
+        << defaults.alias_rate * 100 << ")" << std::endl
+        << "  -s SEED              seed of the generator (default: " << defaults.seed << ")" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    synthetic_params params;
+    bool binary = false;
+    double alias_percent = params.alias_rate * 100;
+    int opt;
+    while ((opt = getopt(argc, argv, "bn:m:d:f:a:s:")) != -1) {
+        bool valid = true;
+        switch (opt) {
+            case 'b':
+                binary = true;
+                break;
+            case 'n':
+                valid = sscanf(optarg, "%lu", &params.count) == 1;
+                break;
+            case 'm':
+                valid = parseMix(optarg, params);
+                break;
+            case 'd':
+                valid = parseDistance(optarg, params.distance);
+                break;
+            case 'f':
+                valid = sscanf(optarg, "%u", &params.footprint) == 1 && params.footprint > 0;
+                break;
+            case 'a':
+                valid = sscanf(optarg, "%lf", &alias_percent) == 1
+                    && alias_percent >= 0 && alias_percent <= 100;
+                break;
+            case 's':
+                valid = sscanf(optarg, "%llu", &params.seed) == 1;
+                break;
+            default:
+                valid = false;
+        }
+        if (!valid) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    params.alias_rate = alias_percent / 100;
+
+    std::vector<instruction> program;
+    generateProgram(params, program);
+    bool written;
+    if (binary) {
+        written = writeProgram(argv[optind], program);
+    } else {
+        std::ofstream fout(argv[optind]);
+        for (const instruction &instn : program)
+            fout << disassemble(instn) << "\n";
+        written = fout.good();
+    }
+    if (!written) {
+        std::cerr << "Cannot write " << argv[optind] << std::endl;
+        return 1;
+    }
+    std::cout << program.size() << " instructions written to " << argv[optind] << std::endl;
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ *  Speed benchmark for the simulator. Runs synthetic programs on the machine of a
+ *  config file with its window scaled to several sizes, and reports how many
+ *  instructions and cycles a second the simulator sustains, so that changes that slow
+ *  it down show up.
+ *  USAGE:- ./ooo_bench [-n COUNT] [-r REPEATS] [-s SEED] [-w SIZE,SIZE,...] [config_file]
+ */
+
+#include <chrono>
+#define OUTOFORDER_NO_MAIN
+#include "outoforder.cpp"
+#include "synthetic.hpp"
+
+// Programs with little and much parallelism, and with few and many memory accesses
+struct bench_workload {
+    const char *name;
+    const char *mix;
+    const char *distance;
+    double alias_rate;
+};
+
+static const bench_workload workloads[] = {
+    { "serial", "100:0:0:0:0", "fixed:1", 0 },
+    { "parallel", "100:0:0:0:0", "geometric:8", 0 },
+    { "mixed", "50:10:2:25:13", "geometric:4", 0.1 },
+    { "memory", "20:0:0:50:30", "geometric:4", 0.3 },
+};
+
+// The reservation station, ROB and rename registers get size entries and the load and
+// store queues half as many
+MachineConfig scaleWindow(const MachineConfig &base, unsigned size) {
+    MachineConfig config = base;
+    config.rs_size = config.rob_size = config.rename_registers = size;
+    config.lq_size = config.sq_size = std::max(size / 2, 1u);
+    config.physical_registers = 0;
+    return config;
+}
+
+void usage(const char *prog) {
+    std::cerr << "USAGE:- " << prog << " [-n COUNT] [-r REPEATS] [-s SEED] [-w SIZE,SIZE,...] [config_file]" << std::endl
+        << "  -n COUNT     instructions in each program (default: 200000)" << std::endl
+        << "  -r REPEATS   runs of each, the fastest is reported (default: 3)" << std::endl
+        << "  -s SEED      seed of the programs (default: 1)" << std::endl
+        << "  -w SIZES     window sizes (default: 16,32,64,128,256)" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long count = 200000;
+    unsigned repeats = 3;
+    unsigned long long seed = 1;
+    std::vector<unsigned> sizes = { 16, 32, 64, 128, 256 };
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:s:w:")) != -1) {
+        bool valid = true;
+        switch (opt) {
+            case 'n':
+                valid = sscanf(optarg, "%lu", &count) == 1 && count > 0;
+                break;
+            case 'r':
+                valid = sscanf(optarg, "%u", &repeats) == 1 && repeats > 0;
+                break;
+            case 's':
+                valid = sscanf(optarg, "%llu", &seed) == 1;
+                break;
+            case 'w': {
+                sizes.clear();
+                std::istringstream list(optarg);
+                std::string size;
+                while (valid && std::getline(list, size, ',')) {
+                    unsigned s;
+                    valid = sscanf(size.c_str(), "%u", &s) == 1 && s > 0;
+                    sizes.push_back(s);
+                }
+                valid = valid && !sizes.empty();
+                break;
+            }
+            default:
+                valid = false;
+        }
+        if (!valid) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    std::string config_filename = (optind < argc) ? argv[optind] : "input_files/config.txt";
+    MachineConfig base;
+    inputConfiguration(config_filename, base);
+
+    std::cout << std::left << std::setw(10) << "workload" << std::right << std::setw(8) << "window"
+        << std::setw(12) << "instns" << std::setw(12) << "cycles" << std::setw(8) << "IPC"
+        << std::setw(10) << "seconds" << std::setw(12) << "instns/s" << std::setw(10) << "ns/cycle"
+        << std::endl << std::fixed;
+    for (const bench_workload &w : workloads) {
+        synthetic_params params;
+        params.count = count;
+        params.seed = seed;
+        params.alias_rate = w.alias_rate;
+        parseMix(w.mix, params);
+        parseDistance(w.distance, params.distance);
+        std::vector<instruction> program;
+        generateProgram(params, program);
+        ProgramImage image;
+        image.assign(program);
+        Workload workload(1, &image);
+
+        for (unsigned size : sizes) {
+            MachineConfig config = scaleWindow(base, size);
+            checkConfiguration(config, config_filename);
+            double best = 0;
+            unsigned long cycles = 0, committed = 0;
+            for (unsigned r = 0; r < repeats; ++r) {
+                Core core(config, workload);
+                auto start = std::chrono::steady_clock::now();
+                cycles = core.simulate(-1UL, 0);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                committed = core.stats.committed;
+                if (r == 0 || elapsed.count() < best)
+                    best = elapsed.count();
+            }
+            std::cout << std::left << std::setw(10) << w.name << std::right << std::setw(8) << size
+                << std::setw(12) << committed << std::setw(12) << cycles
+                << std::setw(8) << std::setprecision(3) << (double)committed / cycles
+                << std::setw(10) << std::setprecision(3) << best
+                << std::setw(12) << std::setprecision(0) << committed / best
+                << std::setw(10) << std::setprecision(1) << best * 1e9 / cycles << std::endl;
+        }
+    }
+    return 0;
+}
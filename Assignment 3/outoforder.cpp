@@ -4,170 +4,281 @@
 #include <sstream>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <memory>
+#include <map>
+#include <thread>
+#include <atomic>
 #include "outoforder.hpp"
 
-#define IPC 2
-
-struct instruction {
-    struct operand {
-        bool is_imm;
-        int field;
-    };
-    unsigned addr;
-    operation_type op;
-    std::array<operand, MAX_ARITY> src;
-    int dest_arf_index;
-};
-std::queue<instruction> instn_buffer;
+//void readConfigFile(std::string config_filename) {
+    //std::ifstream fin(config_filename);
+//}
 
-std::string toupper(std::string& str) {
-    for (size_t i=0; i < str.size(); ++i) {
-        str[i] = std::toupper(str[i]);
-    }
-    return str;
+void configError(const std::string &config_filename, const std::string &msg) {
+    std::cerr << config_filename << ": " << msg << std::endl;
+    std::exit(1);
 }
 
-operation_type decode_instn(std::string instn) {
-    instn = toupper(instn);
-    if (instn == "ADD")      return ADD;
-    else if (instn == "SUB") return SUB;
-    else if (instn == "MUL") return MUL;
-    else if (instn == "DIV") return DIV;
-    else if (instn == "AND") return AND;
-    else if (instn == "OR")  return OR;
-    else if (instn == "XOR") return XOR;
-    else if (instn == "LD")  return LD;
-    else if (instn == "ST")  return ST;
-    else                     return INVALID; 
+// Splits a "name = value" line. Returns false if the line has no '='.
+bool splitSetting(const char *line, std::string &key, std::string &value) {
+    const char *eq = strchr(line, '=');
+    if (!eq)
+        return false;
+    key.assign(line, eq);
+    key.erase(0, key.find_first_not_of(" \t"));
+    key.erase(key.find_last_not_of(" \t") + 1);
+    value = eq + 1;
+    return true;
 }
 
-bool isALUOperation(operation_type op) {
-    return op >= ADD && op <= XOR;
+// Applies one "name = value" setting of config.txt or of a sweep file
+void applySetting(MachineConfig &config, const std::string &key, const std::string &text,
+        const std::string &config_filename) {
+    std::istringstream value(text);
+    std::string op_name;
+    if (key.compare(0, 5, "Unit ") == 0) {
+        unit_type t;
+        t.name = key.substr(5);
+        if (!(value >> t.count))
+            configError(config_filename, "no unit count for " + key);
+        while (value >> op_name) {
+            operation_type op = decode_instn(op_name);
+            if (!isALUOperation(op))
+                configError(config_filename, "unit " + t.name + " cannot execute " + op_name);
+            t.ops.push_back(op);
+        }
+        // A type declared again replaces the earlier declaration
+        auto same = std::find_if(config.unit_types.begin(), config.unit_types.end(),
+                [&t] (const unit_type &u) { return u.name == t.name; });
+        if (same != config.unit_types.end())
+            *same = t;
+        else
+            config.unit_types.push_back(t);
+        return;
+    }
+    if (key == "Branch predictor") {
+        value >> config.predictor;
+        std::unique_ptr<BranchPredictor> p(makePredictor(config.predictor, 1));
+        if (!p)
+            configError(config_filename, "unknown branch predictor " + config.predictor);
+        return;
+    }
+    if (key == "Cache configuration") {
+        std::getline(value >> std::ws, config.cache_config);
+        config.cache_config.erase(config.cache_config.find_last_not_of(" \t\r\n") + 1);
+        CacheHierarchy caches;
+        if (!caches.readConfig(config.cache_config.c_str()))
+            configError(config_filename, "cannot read cache configuration " + config.cache_config);
+        return;
+    }
+    if (key == "Register file") {
+        std::string organisation;
+        value >> organisation;
+        if (organisation != "split" && organisation != "merged")
+            configError(config_filename, "register file must be split or merged");
+        config.merged_registers = organisation == "merged";
+        return;
+    }
+    if (key == "Skip idle cycles") {
+        std::string skip;
+        value >> skip;
+        if (skip != "on" && skip != "off")
+            configError(config_filename, "skip idle cycles must be on or off");
+        config.skip_idle = skip == "on";
+        return;
+    }
+    if (key == "Functional warming") {
+        std::string warming;
+        value >> warming;
+        if (warming != "on" && warming != "off")
+            configError(config_filename, "functional warming must be on or off");
+        config.functional_warming = warming == "on";
+        return;
+    }
+    if (key == "Fetch policy") {
+        std::string policy;
+        value >> policy;
+        if (policy != "icount" && policy != "round-robin")
+            configError(config_filename, "fetch policy must be icount or round-robin");
+        config.fetch_policy = (policy == "icount") ? ICOUNT : ROUND_ROBIN;
+        return;
+    }
+    if (key == "Thread buffers") {
+        std::string sharing;
+        value >> sharing;
+        if (sharing != "partitioned" && sharing != "shared")
+            configError(config_filename, "thread buffers must be partitioned or shared");
+        config.shared_buffers = sharing == "shared";
+        return;
+    }
+    if (key == "Memory disambiguation") {
+        std::string policy;
+        value >> policy;
+        if (policy == "store-sets")
+            config.disambiguation = STORE_SETS;
+        else if (policy == "speculative")
+            config.disambiguation = SPECULATIVE;
+        else if (policy == "conservative")
+            config.disambiguation = CONSERVATIVE;
+        else
+            configError(config_filename, "unknown memory disambiguation " + policy);
+        return;
+    }
+    unsigned n;
+    if (!(value >> n))
+        configError(config_filename, "no value for " + key);
+    std::istringstream words(key);
+    std::string second;
+    if (words >> op_name >> second && (second == "interval" || second == "latency")
+            && words.eof() && isALUOperation(decode_instn(op_name))) {
+        if (n == 0)
+            configError(config_filename, key + " must be at least 1");
+        operation_type op = decode_instn(op_name);
+        if (second == "interval")
+            config.interval[op-ADD] = n;
+        else
+            config.latency[op-ADD] = n;
+    }
+    else if (key == "Size of the reservation station") config.rs_size = n;
+    else if (key == "Size of the re-order buffer") config.rob_size = n;
+    else if (key == "Size of the store buffer") config.sb_size = n;
+    else if (key == "Dispatch width")         config.dispatch_width = n;
+    else if (key == "Issue width")            config.issue_width = n;
+    else if (key == "Number of CDBs")         config.cdb_count = n;
+    else if (key == "Commit width")           config.commit_width = n;
+    else if (key == "Number of ALUs")         config.alu_count = n;
+    else if (key == "Number of load units")   config.load_units = n;
+    else if (key == "Number of store units")  config.store_units = n;
+    else if (key == "Predictor index bits")   config.predictor_bits = n;
+    else if (key == "BTB entries")            config.btb_entries = n;
+    else if (key == "Branch checkpoints")     config.checkpoints = n;
+    else if (key == "ROB walk width")         config.walk_width = n;
+    else if (key == "Number of MSHRs")        config.mshrs = n;
+    else if (key == "Load queue size")        config.lq_size = n;
+    else if (key == "Store queue size")       config.sq_size = n;
+    else if (key == "Store set entries")      config.store_set_entries = n;
+    else if (key == "Rename registers")       config.rename_registers = n;
+    else if (key == "Physical registers")     config.physical_registers = n;
+    else if (key == "Fast-forward")           config.fast_forward = n;
+    else if (key == "Detailed interval")      config.detailed_interval = n;
+    else if (key == "Functional interval")    config.functional_interval = n;
+    else configError(config_filename, "unknown setting \"" + key + "\"");
 }
 
-bool isLoad(operation_type op) {
-    return op == LD;
+// Exits with a message if the machine described cannot run every program
+void checkConfiguration(const MachineConfig &config, const std::string &config_filename) {
+    if (!config.rs_size || !config.rob_size || !config.sb_size)
+        configError(config_filename, "buffer sizes must be at least 1");
+    if (!config.dispatch_width || !config.cdb_count || !config.commit_width
+            || !config.aluCount() || !config.load_units || !config.store_units
+            || !config.btb_entries || !config.walk_width || !config.mshrs
+            || !config.lq_size || !config.sq_size || !config.store_set_entries
+            || !config.rename_registers)
+        configError(config_filename, "widths and unit counts must be at least 1");
+    if (config.merged_registers && config.registerCount() <= ARF_SIZE)
+        configError(config_filename, "a merged register file needs more physical than architected registers");
+    if (config.functional_interval && !config.detailed_interval)
+        configError(config_filename, "a functional interval needs a detailed interval");
+    if (config.predictor_bits < 1 || config.predictor_bits > 24)
+        configError(config_filename, "predictor index bits must be between 1 and 24");
+    // Every ALU operation needs a unit that can execute it
+    for (int op = ADD; op <= XOR; ++op) {
+        bool executed = config.unit_types.empty();
+        for (const unit_type &t : config.unit_types)
+            executed = executed || (t.count > 0
+                    && std::find(t.ops.begin(), t.ops.end(), op) != t.ops.end());
+        if (!executed) {
+            std::ostringstream msg;
+            msg << "no unit executes " << (operation_type)op;
+            configError(config_filename, msg.str());
+        }
+    }
 }
 
-bool isStore(operation_type op) {
-    return op == ST;
+// Exits with a message if the machine cannot run the given number of hardware threads
+void checkThreads(const MachineConfig &config, unsigned threads, const std::string &config_filename) {
+    if (config.merged_registers && config.registerCount(threads) <= threads*ARF_SIZE)
+        configError(config_filename, "a merged register file needs more physical than architected registers");
+    if (!config.shared_buffers && (config.rob_size < threads || config.sb_size < threads
+                || config.lq_size < threads || config.sq_size < threads))
+        configError(config_filename, "partitioned buffers need an entry for each thread");
 }
 
-//void readConfigFile(std::string config_filename) {
-    //std::ifstream fin(config_filename);
-//}
-
-void inputConfiguration(std::string config_filename) {
-    // Take user input for buffer sizes
-    unsigned size;
-    int nargs;
+void inputConfiguration(std::string config_filename, MachineConfig &config) {
     FILE *conf_file = fopen(config_filename.c_str(), "r");
-    nargs = fscanf(conf_file, "Size of the reservation station = %d\n", &size);
-    rs.setSize(size);
-    nargs = fscanf(conf_file, "\nSize of the re-order buffer = %d\n", &size);
-    rob.setSize(size);
-    nargs = fscanf(conf_file, "\nSize of the store buffer = %d\n", &size);
-    sb.setSize(size);
-
-    // Take user input for ALU operation latencies
-    int latency;
-    nargs = fscanf(conf_file, "\nADD latency = %d\n", &latency);
-    IntegerALU::setLatency(ADD, latency);
-    nargs = fscanf(conf_file, "\nSUB latency = %d\n", &latency);
-    IntegerALU::setLatency(SUB, latency);
-    nargs = fscanf(conf_file, "\nMUL latency = %d\n", &latency);
-    IntegerALU::setLatency(MUL, latency);
-    nargs = fscanf(conf_file, "\nDIV latency = %d\n", &latency);
-    IntegerALU::setLatency(DIV, latency);
-    nargs = fscanf(conf_file, "\nAND latency = %d\n", &latency);
-    IntegerALU::setLatency(AND, latency);
-    nargs = fscanf(conf_file, "\nOR latency = %d\n", &latency);
-    IntegerALU::setLatency(OR, latency);
-    nargs = fscanf(conf_file, "\nXOR latency = %d", &latency);
-    IntegerALU::setLatency(XOR, latency);
-}
-
-void initialiseMemoryAndARF() {
-  for (size_t i=0; i<memory.size(); i++) {
-      memory[i] = 1;
-  }
-  arf.initialise();
-}
-
-void fetchDecodeInstructions(std::string instruction_filename) {
-
-    std::ifstream fin(instruction_filename);
-    std::string line;
-    int i = 1;
-    while (std::getline(fin, line)) {
-
-        if (line.empty()) continue;
-
-        instruction instn;
-        std::istringstream iss(line);
-        std::string op, src[MAX_ARITY], dest;
-
-        iss >> op;
-        instn.op = decode_instn(op);
-        if (instn.op == INVALID) {
-            std::cerr << "Instruction " << i << ": operation invalid." << std::endl;
-            std::exit(1);
+    if (!conf_file) {
+        std::cerr << "Cannot open " << config_filename << std::endl;
+        std::exit(1);
+    }
+    // The buffer sizes and ALU operation latencies come first, in this order
+    struct mandatory_setting {
+        const char *name;
+        unsigned *value;
+    } mandatory[] = {
+        { "Size of the reservation station", &config.rs_size },
+        { "Size of the re-order buffer", &config.rob_size },
+        { "Size of the store buffer", &config.sb_size },
+        { "ADD latency", &config.latency[ADD] },
+        { "SUB latency", &config.latency[SUB] },
+        { "MUL latency", &config.latency[MUL] },
+        { "DIV latency", &config.latency[DIV] },
+        { "AND latency", &config.latency[AND] },
+        { "OR latency", &config.latency[OR] },
+        { "XOR latency", &config.latency[XOR] },
+    };
+    for (const mandatory_setting &m : mandatory) {
+        std::string format = std::string(" ") + m.name + " = %u";
+        if (fscanf(conf_file, format.c_str(), m.value) != 1) {
+            fclose(conf_file);
+            configError(config_filename, "expected \"" + std::string(m.name) + " = n\"");
         }
+    }
 
-        if (instn.op == ST) {
-            instn.dest_arf_index = -1;
-        } else {
-            iss >> dest;
-            try {
-                if (dest[0] == 'R' || dest[0] == 'r') {
-                    instn.dest_arf_index = std::stoi(dest.substr(1))-1;
-                } else {
-                    instn.dest_arf_index = std::stoi(dest.substr(1));
-                }
-            } catch (std::invalid_argument e) {
-                std::cerr << "Instruction " << i << ": destination operand invalid." << std::endl;
-                std::exit(1);
-            }
-        }
- 
-        try {
-            for (int j = 0; j < arity[instn.op]; ++j)
-            {
-                iss >> src[j];
-                if (src[j][0] == 'R' || src[j][0] == 'r') {
-                    instn.src[j].field = std::stoi(src[j].substr(1))-1;
-                    instn.src[j].is_imm = false;
-                } else {
-                    instn.src[j].field = std::stoi(src[j]);
-                    instn.src[j].is_imm = true;
-                }
-            }
-        } catch (std::invalid_argument e) {
-            std::cerr << "Instruction " << i << ": source operand invalid." << std::endl;
-            std::exit(1);
+    // Optional settings, one "name = value" per line in any order:
+    //   widths and unit counts, e.g. "Commit width = 2"
+    //   initiation intervals, e.g. "MUL interval = 1"
+    //   ALU types, e.g. "Unit MULDIV = 1 MUL DIV" for one unit executing MUL and DIV
+    //   branch prediction, e.g. "Branch predictor = gshare"
+    //   data caches, e.g. "Cache configuration = ../Assignment 2/config/LRU_config.txt"
+    //   memory disambiguation, e.g. "Memory disambiguation = conservative"
+    //   hardware threads, e.g. "Fetch policy = round-robin" or "Thread buffers = shared"
+    //   fast-forwarding and sampling, e.g. "Fast-forward = 1000000"
+    char line[256];
+    std::string key, value;
+    while (fgets(line, sizeof(line), conf_file)) {
+        if (!splitSetting(line, key, value)) {
+            if (strspn(line, " \t\r\n") != strlen(line))
+                configError(config_filename, "expected \"name = value\": " + std::string(line));
+            continue;
         }
-
-        instn.addr = i++;
-        instn_buffer.push(instn);
+        applySetting(config, key, value, config_filename);
     }
+    fclose(conf_file);
+    checkConfiguration(config, config_filename);
+}
 
-    //for (size_t i = 0; i < instn_buffer.size(); ++i) {
-        //instruction &in = instn_buffer[i];
-        //std::cout << in.op << "\t";
-        //for (int j = 0; j < arity[in.op]; ++j) {
-            //std::cout << in.src[j].is_imm << " " << in.src[j].field << ", ";
-        //}
-        //std::cout << in.dest.is_imm << " " << in.dest_arf_index << std::endl;
-    //}
+void Core::initialiseMemoryAndARF(HardwareThread &t) {
+  t.memory.clear();
+  t.arf.initialise();
 }
 
 // Allocate reservation station entry for given instruction after register renaming
-void allocateResStnEntry(const instruction& instn, int dest_rrf_index) {
+void Core::allocateResStnEntry(HardwareThread &t, const instruction& instn, int dest_rrf_index) {
     // set reservation station entry values
     rs_entry rse;
     rse.op_type = instn.op;
     rse.addr = instn.addr;
     rse.dest = dest_rrf_index;
+    // The ROB entry allocated next belongs to the same instruction
+    rse.seq = next_seq;
+    rse.thread = t.id;
+    rse.rob_index = t.rob.tail();
+    if (isLoad(instn.op))
+        rse.lsq_index = t.lq.tail();
+    else if (isStore(instn.op))
+        rse.lsq_index = t.sq.tail();
     // lookup operands
     for (int i = 0; i < arity[rse.op_type]; ++i)
     {
@@ -179,11 +290,11 @@ void allocateResStnEntry(const instruction& instn, int dest_rrf_index) {
             // get ARF index of src i
             int r = instn.src[i].field;
             // if ARF reg r is not busy, directly copy data from r to res stn
-            if (!arf[r].busy) {
+            if (!t.arf[r].busy) {
                 rse.src[i].ready = true;
-                rse.src[i].field = arf[r].data;
+                rse.src[i].field = t.arf[r].data;
             } else {
-                int s = arf[r].tag;
+                int s = t.arf[r].tag;
                 // if r is busy and its RRF reg s is valid, directly copy data from s
                 if (rrf[s].valid) {
                     rse.src[i].ready = true;
@@ -200,224 +311,1337 @@ void allocateResStnEntry(const instruction& instn, int dest_rrf_index) {
 }
 
 // Allocate re-order buffer entry for given instruction after register renaming
-void allocateROBEntry(const instruction& instn, int dest_rrf_index) {
+void Core::allocateROBEntry(HardwareThread &t, const instruction& instn, int dest_rrf_index) {
     rob_entry robe;
     robe.addr = instn.addr;
     robe.arf_index = instn.dest_arf_index;
     robe.rrf_index = dest_rrf_index;
-    rob.push(robe);
+    robe.seq = next_seq++;
+    progress++;
+    robe.op = instn.op;
+    robe.history = t.global_history;
+    // Fetch and dispatch take the same cycle
+    robe.timeline[FETCH] = robe.timeline[DISPATCH] = cycle;
+    t.rob.push(robe);
 }
 
-void dispatchInstn(const instruction& instn) {
+// Returns a free rename map checkpoint holding the current map, or -1 if there is none
+int Core::saveCheckpoint(HardwareThread &t) {
+    for (size_t i=0; i < t.checkpoints.size(); ++i) {
+        rename_map &m = t.checkpoints[i];
+        if (m.used) continue;
+        m.used = true;
+        for (int r=0; r < t.arf.size(); ++r) {
+            m.busy[r] = t.arf[r].busy;
+            m.tag[r] = t.arf[r].tag;
+        }
+        return i;
+    }
+    return -1;
+}
+
+void Core::freeCheckpoint(HardwareThread &t, int c) {
+    if (c >= 0)
+        t.checkpoints[c].used = false;
+}
+
+stall_reason Core::dispatchInstn(HardwareThread &t, const instruction& instn) {
     // Check if there is an entry available in each of
     // the RRF, reservation station and re-order buffer
-    if (rrf.full() || rs.full() || rob.full()) throw buffer_overflow_error("RRF/RS/ROB full");
+    if (rrf.full()) return RRF_FULL;
+    if (rs.full()) return RS_FULL;
+    if (full(t, &HardwareThread::rob, config.rob_size)) return ROB_FULL;
+    if (isLoad(instn.op) && full(t, &HardwareThread::lq, config.lq_size)) return LQ_FULL;
 
     // find free rename register
-    int rrf_index = rrf.nextIndex();
-    rrf[rrf_index].busy = true;
+    int rrf_index = rrf.allocate();
 
     // Allocate reservation station entry
-    allocateResStnEntry(instn, rrf_index);
+    allocateResStnEntry(t, instn, rrf_index);
+
+    // Allocate load queue entry
+    if (isLoad(instn.op)) {
+        lq_entry lqe;
+        lqe.seq = next_seq;
+        lqe.rob_index = t.rob.tail();
+        lqe.pc = instn.addr;
+        if (config.disambiguation == STORE_SETS)
+            lqe.wait_for = store_sets.loadFetched(instn.addr);
+        t.lq.push(lqe);
+    }
 
     // Rename destination register
-    arf[instn.dest_arf_index].busy = true;
-    arf[instn.dest_arf_index].tag = rrf_index;
+    t.arf[instn.dest_arf_index].busy = true;
+    t.arf[instn.dest_arf_index].tag = rrf_index;
 
     // Allocate re-order buffer entry
-    allocateROBEntry(instn, rrf_index);
+    allocateROBEntry(t, instn, rrf_index);
+    return NO_STALL;
 }
 
-void dispatchStoreInstn(const instruction &instn) {
+stall_reason Core::dispatchStoreInstn(HardwareThread &t, const instruction &instn) {
     // Check if there is an entry available in both of
     // the reservation station and re-order buffer
-    if (rs.full() || rob.full()) throw buffer_overflow_error("RS/ROB full");
-      
+    if (rs.full()) return RS_FULL;
+    if (full(t, &HardwareThread::rob, config.rob_size)) return ROB_FULL;
+    if (full(t, &HardwareThread::sq, config.sq_size)) return SQ_FULL;
+
     // Allocate reservation station entry
-    allocateResStnEntry(instn, -1);
+    allocateResStnEntry(t, instn, -1);
+    // Allocate store queue entry
+    sq_entry sqe;
+    sqe.seq = next_seq;
+    sqe.pc = instn.addr;
+    store_sets.storeFetched(instn.addr, next_seq);
+    t.sq.push(sqe);
     // Allocate re-order buffer entry
-    allocateROBEntry(instn, -1);
+    allocateROBEntry(t, instn, -1);
+    return NO_STALL;
+}
+
+// Predicts a branch and enters it in the ROB. A conditional branch also takes a
+// reservation station entry and, if one is free, a checkpoint of the rename map. A
+// jump is resolved here since its target is known.
+stall_reason Core::dispatchBranchInstn(HardwareThread &t, const instruction &instn) {
+    bool conditional = isConditionalBranch(instn.op);
+    if (conditional && rs.full()) return RS_FULL;
+    if (full(t, &HardwareThread::rob, config.rob_size)) return ROB_FULL;
+
+    if (conditional)
+        allocateResStnEntry(t, instn, -1);
+    allocateROBEntry(t, instn, -1);
+    rob_entry &robe = t.rob.back();
+    robe.arf_index = -1;
+    robe.is_branch = true;
+    robe.target = instn.target;
+    robe.history = t.global_history;
+    if (conditional) {
+        robe.predicted_taken = predictor->predict(instn.addr, t.global_history);
+        t.global_history = t.global_history << 1 | robe.predicted_taken;
+        robe.checkpoint = saveCheckpoint(t);
+    } else {
+        robe.predicted_taken = robe.taken = robe.resolved = true;
+    }
+    return NO_STALL;
 }
 
-void dispatch(const instruction &instn) {
-    if (isStore(instn.op))
-        dispatchStoreInstn(instn);
+// Returns NO_STALL if the instruction was dispatched, or the buffer that was full
+stall_reason Core::dispatch(HardwareThread &t, const instruction &instn) {
+    if (isBranch(instn.op))
+        return dispatchBranchInstn(t, instn);
+    else if (isStore(instn.op))
+        return dispatchStoreInstn(t, instn);
     else
-        dispatchInstn(instn);
-}
-
-void forwardOperand(int tag, int data) {
-    // Forward results to reservation station
-    for (int i=0; i < rs.size(); ++i) {
-        if (!rs[i].busy) continue;
-        for (int j=0; j < MAX_ARITY; ++j) {
-            rs_entry::op_info &s = rs[i].src[j];
-            if (s.ready) continue;
-            if (s.field == tag) {
-                s.ready = true;
-                s.field = data;
-            }
+        return dispatchInstn(t, instn);
+}
+
+// Fetches and dispatches up to the dispatch width of instructions of thread t,
+// following the predicted path. A branch predicted taken ends the group, and if the
+// BTB does not have its target, fetch loses the next cycle as well. Returns true if
+// any instruction was dispatched.
+bool Core::fetchAndDispatch(HardwareThread &t) {
+    unsigned i = 0;
+    for (; i < config.dispatch_width && t.fetch_pc < t.program->size(); ++i) {
+        const instruction &instn = t.fetch_buffer.fetch(t.fetch_pc);
+        stall_reason stall = dispatch(t, instn);
+        if (stall != NO_STALL) {
+            stats.stalls[stall]++;
+            break;
+        }
+        if (!isBranch(instn.op) || !t.rob.back().predicted_taken) {
+            ++t.fetch_pc;
+            continue;
+        }
+        t.fetch_pc = instn.target;
+        if (!btb.lookup(instn.addr, instn.target)) {
+            stats.btb_misses++;
+            t.btb_bubble = true;
+        }
+        return true;
+    }
+    return i > 0;
+}
+
+// Gives the fetch stage of this cycle to one thread. Threads rebuilding their rename
+// map or waiting out a BTB miss cannot fetch. The others are tried in the order of
+// the fetch policy until one dispatches something: with round-robin, starting from a
+// different thread each cycle, and with ICOUNT, starting from the one with the fewest
+// instructions in the reservation station.
+void Core::fetchStage(bool draining) {
+    std::array<HardwareThread*, MAX_THREADS> order;
+    size_t n = 0;
+    for (size_t i = 0; i < threads.size(); ++i) {
+        HardwareThread &t = threads[(cycle + i) % threads.size()];
+        if (t.recovery_cycles > 0) {
+            t.recovery_cycles--;
+            stats.stalls[RENAME_RECOVERY]++;
+        } else if (t.btb_bubble) {
+            t.btb_bubble = false;
+            stats.stalls[BTB_MISS]++;
+        } else if (!draining && t.fetch_pc < t.program->size()) {
+            order[n++] = &t;
         }
     }
+    if (n > 1 && config.fetch_policy == ICOUNT) {
+        std::array<unsigned, MAX_THREADS> waiting = {};
+        for (int i = 0; i < rs.size(); ++i)
+            if (rs[i].busy)
+                waiting[rs[i].thread]++;
+        std::stable_sort(order.begin(), order.begin() + n,
+                [&waiting] (const HardwareThread *a, const HardwareThread *b) {
+                    return waiting[a->id] < waiting[b->id];
+                });
+    }
+    for (size_t i = 0; i < n; ++i)
+        if (fetchAndDispatch(*order[i]))
+            break;
+}
+
+// Removes every instruction of thread t younger than seq from the ROB, RS, RRF, LSQ,
+// functional units and CDBs. Returns the number of ROB entries removed.
+unsigned long Core::squashYoungerThan(HardwareThread &t, unsigned long seq) {
+    unsigned long squashed = 0;
+    while (!t.rob.empty() && t.rob.back().seq > seq) {
+        rob_entry &e = t.rob.back();
+        if (e.rrf_index >= 0)
+            rrf.pop(e.rrf_index);
+        if (e.is_branch)
+            freeCheckpoint(t, e.checkpoint);
+        if (timeline_writer)
+            traceInstruction(t, e, true);
+        t.rob.popBack();
+        ++squashed;
+    }
+    for (int i=0; i < rs.size(); ++i)
+        if (rs[i].busy && rs[i].thread == t.id && rs[i].seq > seq)
+            rs.pop(i);
+    while (!t.lq.empty() && t.lq.back().seq > seq)
+        t.lq.popBack();
+    while (!t.sq.empty() && t.sq.back().seq > seq)
+        t.sq.popBack();
+    for (IntegerALU &alu : alus)
+        alu.squash(t.id, seq);
+    for (LoadUnit &ldu : ldus)
+        ldu.squash(t.id, seq);
+    for (bus &cdb : cdbs)
+        if (cdb.busy && cdb.thread == t.id && cdb.seq > seq)
+            cdb.busy = false;
+    stats.squashed += squashed;
+    return squashed;
+}
+
+// Rebuilds the rename map from the instructions left in the ROB, which costs a cycle
+// for every walk width of squashed entries
+void Core::walkRenameMap(HardwareThread &t, unsigned long squashed) {
+    ArchitectedRegisterFile &arf = t.arf;
+    ReOrderBuffer &rob = t.rob;
+    for (int r=0; r < arf.size(); ++r) {
+        arf[r].busy = config.merged_registers;
+        arf[r].tag = config.merged_registers ? t.retirement_map[r] : 0;
+    }
+    for (int i = rob.head(), n = 0; n < rob.entryCount(); i = (i+1) % rob.size(), ++n) {
+        if (rob[i].arf_index < 0 || rob[i].rrf_index < 0) continue;
+        arf[rob[i].arf_index].busy = true;
+        arf[rob[i].arf_index].tag = rob[i].rrf_index;
+    }
+    t.recovery_cycles = (squashed + config.walk_width - 1) / config.walk_width;
+}
+
+// Removes every instruction younger than the mispredicted branch at ROB index b,
+// restores the rename map and redirects fetch to the correct path
+void Core::squashAfter(HardwareThread &t, int b) {
+    rob_entry &br = t.rob[b];
+    unsigned long squashed = squashYoungerThan(t, br.seq);
+    if (br.checkpoint >= 0) {
+        const rename_map &m = t.checkpoints[br.checkpoint];
+        for (int r=0; r < t.arf.size(); ++r) {
+            t.arf[r].busy = m.busy[r];
+            t.arf[r].tag = m.tag[r];
+        }
+        freeCheckpoint(t, br.checkpoint);
+        br.checkpoint = -1;
+    } else {
+        walkRenameMap(t, squashed);
+    }
+
+    t.global_history = br.history << 1 | br.taken;
+    // addr counts instructions from 1, so it is also the index of the fall-through
+    t.fetch_pc = br.taken ? br.target : br.addr;
+    t.btb_bubble = false;
+}
+
+// Squashes a load that read a stale value together with everything after it, and
+// fetches it again
+void Core::replayLoad(HardwareThread &t, const lq_entry &ld) {
+    unsigned long seq = ld.seq;
+    unsigned pc = ld.pc;
+    uint64_t history = t.rob[ld.rob_index].history;
+    walkRenameMap(t, squashYoungerThan(t, seq - 1));
+    t.global_history = history;
+    t.fetch_pc = pc - 1;
+    t.btb_bubble = false;
+}
+
+// Records the outcome of the branches that finished this cycle, oldest first. The
+// first mispredicted one squashes the younger instructions, including any younger
+// branches that also finished this cycle.
+void Core::resolveBranches() {
+    std::sort(branch_results.begin(), branch_results.end(),
+            [] (const branch_result &a, const branch_result &b) { return a.seq < b.seq; });
+    for (const branch_result &r : branch_results) {
+        HardwareThread &t = threads[r.thread];
+        rob_entry &br = t.rob[r.rob_index];
+        progress++;
+        if (!br.busy || br.seq != r.seq) continue;
+        br.resolved = true;
+        br.taken = r.taken;
+        if (br.taken != br.predicted_taken)
+            squashAfter(t, r.rob_index);
+    }
+    branch_results.clear();
+}
+
+void Core::forwardOperand(int tag, int data) {
+    progress++;
+    // Forward results to the reservation station entries waiting for them
+    rs.wakeup(tag, data);
     // Forward results to RRF
     rrf[tag].valid = true;
     rrf[tag].data = data;
 }
 
-void execute() {
-    // Execute pending instructions for another cycle
-    for (size_t i=0; i < alus.size(); ++i) {
-        alus[i].updateTimer();
+// Finds the value of the load in RS entry i and records it in its LQ entry. Older
+// stores are searched from the youngest, then the store buffer, then memory. Returns
+// NO_STALL if the value was found, or why the load has to wait: an older store whose
+// address is unknown may write its location (MEM_DEPENDENCE), or it misses and every
+// MSHR is taken (MSHR_FULL).
+stall_reason Core::readLoadValue(const rs_entry &rse) {
+    HardwareThread &t = threads[rse.thread];
+    MemoryQueue<lq_entry> &lq = t.lq;
+    MemoryQueue<sq_entry> &sq = t.sq;
+    StoreBuffer &sb = t.sb;
+    lq_entry &ld = lq[rse.lsq_index];
+    unsigned addr = rse.src[0].field;
+    int forward = -1;
+    for (int n = sq.entryCount() - 1; n >= 0 && forward < 0; --n) {
+        sq_entry &st = sq[sq.at(n)];
+        if (st.seq > ld.seq) continue;
+        if (!st.executed) {
+            // Speculate that the store writes elsewhere unless told otherwise
+            if (config.disambiguation == CONSERVATIVE
+                    || (config.disambiguation == STORE_SETS && st.seq == ld.wait_for))
+                return MEM_DEPENDENCE;
+        } else if (st.mem_addr == addr) {
+            forward = sq.at(n);
+        }
+    }
+
+    ld.mem_addr = addr;
+    ld.source = 0;
+    if (forward >= 0) {
+        ld.value = sq[forward].data;
+        ld.source = sq[forward].seq;
+        ld.latency = dcache.forwardLatency();
+        stats.forwarded++;
+    } else {
+        int index = (sb.tail()) ? sb.tail() - 1 : sb.size() - 1;
+        for (int i = 0; i < sb.entryCount() && forward < 0; ++i) {
+            if (sb[index].mem_addr == addr)
+                forward = index;
+            index = (index) ? index - 1 : sb.size() - 1;
+        }
+        if (forward >= 0) {
+            ld.value = sb[forward].data;
+            ld.latency = dcache.forwardLatency();
+            stats.forwarded++;
+        } else {
+            if (!dcache.canAccess(cacheAddress(t, addr)))
+                return MSHR_FULL;
+            ld.value = t.memory.read(addr);
+            ld.latency = dcache.read(cacheAddress(t, addr));
+            mem_bus.busy = true;
+        }
+    }
+    ld.executed = true;
+    size_t latency = ld.latency;
+    if (latency >= stats.load_latency.size())
+        stats.load_latency.resize(latency + 1);
+    stats.load_latency[latency]++;
+    return NO_STALL;
+}
+
+// Checks the loads younger than a store that has just executed. The oldest one that
+// read the location the store writes, without getting the value from this store or a
+// younger one, read a stale value: it is replayed, and the store set predictor learns
+// that the two conflict.
+void Core::checkMemoryOrder(HardwareThread &t, const sq_entry &st) {
+    store_sets.storeExecuted(st.pc, st.seq);
+    for (int n = 0; n < t.lq.entryCount(); ++n) {
+        const lq_entry &ld = t.lq[t.lq.at(n)];
+        if (ld.seq < st.seq || !ld.executed || ld.mem_addr != st.mem_addr || ld.source >= st.seq)
+            continue;
+        stats.violations++;
+        store_sets.violation(ld.pc, st.pc);
+        replayLoad(t, ld);
+        return;
     }
-    ldu.updateTimer();
-    stu.updateTimer();
+}
+
+void Core::execute() {
+    mem_bus.busy = false;
+    // Execute pending instructions for another cycle
+    for (IntegerALU &alu : alus)
+        alu.updateTimer(*this);
+    dcache.tick();
+    for (LoadUnit &ldu : ldus)
+        ldu.updateTimer(*this);
+    for (StoreUnit &stu : stus)
+        stu.updateTimer(*this);
+    bool cdb_conflict = false;
+    for (const IntegerALU &alu : alus)
+        cdb_conflict = cdb_conflict || alu.waitingForCDB();
+    for (const LoadUnit &ldu : ldus)
+        cdb_conflict = cdb_conflict || ldu.waitingForCDB();
+    if (cdb_conflict)
+        stats.stalls[CDB_CONFLICT]++;
+    resolveBranches();
 
-    // Forward results from CDB if available
-    if (cdb.busy) {
+    // Forward results from the CDBs if available
+    for (bus &cdb : cdbs) {
+        if (!cdb.busy) continue;
+        stats.cdb_busy++;
         forwardOperand(cdb.tag, cdb.data);
         cdb.busy = false;
     }
 
-    // Issue ready instructions to functional units
-    for (size_t i : rs.indices_in_q_order()) {
+    // Issue ready instructions to functional units, oldest first
+    bool alu_stall = false, mshr_stall = false, dependence_stall = false;
+    unsigned issued = 0;
+    // Thread, SQ index and seq of the stores executed
+    struct executed_store {
+        int thread;
+        int sq_index;
+        unsigned long seq;
+    };
+    std::vector<executed_store> stores;
+    for (size_t i = rs.oldestReady(); i < (size_t)rs.size(); i = rs.nextReady(i)) {
         rs_entry &rse = rs[i];
-        if (!rse.all_ops_ready()) continue;
         operation_type op = rse.op_type;
-        //TODO: Deal with load/stores
-        if (isALUOperation(op)) {
-            auto alu = std::find_if_not(
-                    alus.begin(), alus.end(),
-                    [] (IntegerALU a) { return a.busy; } );
-            if (alu == alus.end()) continue; // if there is no free ALU
-            alu->executeInstn(i);
+        FunctionalUnit *unit = NULL;
+        if (executesOnALU(op)) {
+            unit = freeALU(op);
+            if (!unit) { // if there is no free ALU
+                alu_stall = true;
+                continue;
+            }
         } else if (isLoad(op)) {
-            if (ldu.busy) continue;
-            ldu.executeInstn(i);
+            unit = freeUnit(ldus);
+        } else if (isStore(op)) {
+            unit = freeUnit(stus);
+        }
+        if (!unit) continue;
+        if (issued == config.issueWidth()) break;
+        if (isLoad(op)) {
+            stall_reason wait = readLoadValue(rse);
+            mshr_stall = mshr_stall || wait == MSHR_FULL;
+            dependence_stall = dependence_stall || wait == MEM_DEPENDENCE;
+            if (wait != NO_STALL) continue;
         } else if (isStore(op)) {
-            if (stu.busy) continue;
-            stu.executeInstn(i);
+            stores.push_back(executed_store{rse.thread, rse.lsq_index, rse.seq});
         }
+        stamp(rse.thread, rse.rob_index, ISSUE);
+        unit->executeInstn(*this, i);
+        ++issued;
+        progress++;
+    }
+    if (alu_stall)
+        stats.stalls[NO_FREE_ALU]++;
+    if (mshr_stall)
+        stats.stalls[MSHR_FULL]++;
+    if (dependence_stall)
+        stats.stalls[MEM_DEPENDENCE]++;
+
+    // Stores are checked against the loads once nothing else issues this cycle, since
+    // a violation squashes part of the reservation station
+    for (const executed_store &st : stores) {
+        HardwareThread &t = threads[st.thread];
+        if (t.sq[st.sq_index].seq == st.seq)
+            checkMemoryOrder(t, t.sq[st.sq_index]);
     }
 }
 
-void complete() {
-    mem_bus.busy = false;
-    if (rob.empty()) return;
+// Works on the instruction at the head of the ROB. Returns true if it was retired.
+bool Core::commitHead(HardwareThread &t) {
+    ReOrderBuffer &rob = t.rob;
+    ArchitectedRegisterFile &arf = t.arf;
+    if (rob.empty()) return false;
     rob_entry& head = rob.front();
+    operation_type op = head.op;
 
-    // find the res stn entry corresponding to this rob entry, if it exists
-    int rs_index = -1;
-    for (int i=0; i < rs.size(); ++i) {
-        if (rs[i].addr == head.addr) {
-            rs_index = i;
-            break;
+    if (isStore(op)) {
+        // Insert a store entry in the store buffer
+        sq_entry &st = t.sq.front();
+        if (!st.executed) return false;
+        if (full(t, &HardwareThread::sb, config.sb_size)) {
+            stats.stalls[SB_FULL]++;
+            return false;
         }
-    }
-      
-    // if the res stn entry was found (wiil only occur when there is a load/store instn)
-    if (rs_index >= 0) {
-        rs_entry& rse = rs[rs_index];
-        if (isStore(rse.op_type)) {
-            // Insert a store entry in the store buffer
-            if (sb.full()) return;
-            sb_entry sbe;
-            sbe.mem_addr = rse.src[0].field; // Dest memory address
-            sbe.data = rse.src[1].field; // Data to be written
-            sb.push(sbe);
-            // Remove the store instn from head of ROB
-            rob.pop();
-        } else if (isLoad(rse.op_type)) {
-            unsigned load_mem_addr = rse.src[0].field;
-            int i = 0;
-            int index = (sb.tail()) ? sb.tail() - 1 : sb.size() - 1;
-            for (; i < sb.entryCount(); ++i) {
-                // Load forwarding
-                if (sb[index].mem_addr == load_mem_addr) {
-                    sb[index].rrf_indices_to_update.push(rse.dest);
-                    break;
-                }
-                index = (index) ? index - 1 : sb.size() - 1;
-            }
-            // Load bypassing if no matching store buffer entry found
-            if (i == sb.entryCount()) {
-                mem_bus.busy = true;
-                forwardOperand(rse.dest, memory[load_mem_addr]);
-            }
-            // NOTE:- In the case of load, the rob entry is left at the head
-            // to be removed in the next iteration
+        sb_entry sbe;
+        sbe.mem_addr = st.mem_addr; // Dest memory address
+        sbe.data = st.data; // Data to be written
+        t.sb.push(sbe);
+        // Remove the store instn from head of ROB
+        t.sq.pop();
+        recordCommit(t, head);
+        rob.pop();
+        return true;
+    } else if (head.is_branch) {
+        if (!head.resolved) return false;
+        if (head.taken)
+            btb.insert(head.addr, head.target);
+        if (isConditionalBranch(op)) {
+            predictor->update(head.addr, head.history, head.taken);
+            stats.branches++;
+            stats.mispredictions += head.taken != head.predicted_taken;
         }
-        // Clear res stn entry
-        rs.pop(rs_index);
+        freeCheckpoint(t, head.checkpoint);
+        recordCommit(t, head);
+        rob.pop();
+        return true;
     } else {
         // Write back to ARF
         arf_entry& r = arf[head.arf_index];
         rrf_entry& s = rrf[head.rrf_index];
-        if (!s.valid) return;
+        if (!s.valid) {
+            if (isLoad(op))
+                stats.stalls[LOAD_PENDING]++;
+            return false;
+        }
+        // The ARF data is only a copy for the dumps with a merged register file
         r.data = s.data;
-        if (r.tag == head.rrf_index) {
-            r.busy = false;
+        if (config.merged_registers) {
+            // The value stays where it is; the register it replaces is free
+            rrf.pop(t.retirement_map[head.arf_index]);
+            t.retirement_map[head.arf_index] = head.rrf_index;
+        } else {
+            if (r.tag == head.rrf_index) {
+                r.busy = false;
+            }
+            // Checkpoints still mapping the register to this RRF entry must see it retire
+            for (rename_map &m : t.checkpoints) {
+                if (m.used && m.busy[head.arf_index] && m.tag[head.arf_index] == head.rrf_index)
+                    m.busy[head.arf_index] = false;
+            }
+            rrf.pop(head.rrf_index);
         }
-        rrf.pop(head.rrf_index);
+        if (isLoad(op))
+            t.lq.pop();
+        recordCommit(t, head);
         rob.pop();
+        return true;
     }
 }
 
-void retire() {
-    // Wait for memory bus to become free
-    // NOTE:- This gives preference to loads over stores as they get
-    // a chance to use the bus in the previous complete() step
-    if (mem_bus.busy) return;
-    if (sb.empty()) return;
+// Counts a committed instruction and notes where the correct path goes after it
+void Core::recordCommit(HardwareThread &t, const rob_entry &head) {
+    stats.committed++;
+    stats.thread_committed[t.id]++;
+    progress++;
+    t.committed_seq = head.seq;
+    // addr counts instructions from 1, so it is also the index of the fall-through
+    t.committed_pc = (head.is_branch && head.taken) ? head.target : head.addr;
+    t.committed_history = head.history;
+    if (isConditionalBranch(head.op))
+        t.committed_history = head.history << 1 | head.taken;
+    if (timeline_writer)
+        traceInstruction(t, head, false);
+}
+
+// Writes the timeline of an instruction leaving the ROB this cycle
+void Core::traceInstruction(HardwareThread &t, const rob_entry &e, bool squashed) {
+    stage_cycles cycles = e.timeline;
+    cycles[RETIRE] = cycle;
+    timeline_writer->write(e.seq, t.id, e.addr, e.op, squashed, cycles);
+}
 
+// Commits up to the commit width of instructions, from each thread in turn starting
+// with a different one every cycle
+void Core::complete() {
+    unsigned committed = 0;
+    for (size_t i = 0; i < threads.size() && committed < config.commit_width; ++i) {
+        HardwareThread &t = threads[(cycle + i) % threads.size()];
+        while (committed < config.commit_width && commitHead(t))
+            ++committed;
+    }
+}
+
+// Works on the write at the head of the store buffer of thread t. Only one write a
+// cycle can use the memory bus, so bus_taken says whether another thread's store
+// buffer has it. Returns true if this one used the bus.
+bool Core::retire(HardwareThread &t, bool bus_taken) {
+    StoreBuffer &sb = t.sb;
+    if (sb.empty()) return false;
     // Get the first entry in the buffer
     sb_entry& head = sb.front();
-    // Update memory
-    memory[head.mem_addr] = head.data;
-    // As long as some pending load needs this data to be forwarded, do so
-    if (!head.rrf_indices_to_update.empty()) {
-        int rrf_index = head.rrf_indices_to_update.front();
-        forwardOperand(rrf_index, head.data);
-        head.rrf_indices_to_update.pop();
-        if (!head.rrf_indices_to_update.empty())
-            return;
+    // A write that missed waits for its line without holding the bus
+    if (head.timer > 0 && --head.timer > 0)
+        return false;
+
+    // Wait for memory bus to become free
+    // NOTE:- This gives preference to loads over stores as they get
+    // a chance to use the bus in the previous execute() step
+    if (mem_bus.busy || bus_taken) {
+        stats.stalls[MEM_BUS_BUSY]++;
+        return false;
+    }
+    if (head.timer < 0) {
+        if (!dcache.canAccess(cacheAddress(t, head.mem_addr))) {
+            stats.stalls[MSHR_FULL]++;
+            return false;
+        }
+        head.timer = dcache.write(cacheAddress(t, head.mem_addr)) - 1;
+        progress++;
+        if (head.timer > 0)
+            return true;
     }
+    // Update memory
+    t.memory.write(head.mem_addr, head.data);
     // Remove this entry from the head of the queue
     sb.pop();
+    progress++;
+    return true;
+}
+
+// Adds the state of the machine at the end of a cycle to the statistics, once for
+// each of the given number of cycles spent in that state
+void Core::sampleCycle(unsigned long cycles) {
+    for (size_t i=0; i < alus.size(); ++i)
+        stats.alu_busy[i] += alus[i].busy * cycles;
+    for (const LoadUnit &ldu : ldus)
+        stats.ldu_busy += ldu.busy * cycles;
+    for (const StoreUnit &stu : stus)
+        stats.stu_busy += stu.busy * cycles;
+    stats.mem_bus_busy += mem_bus.busy * cycles;
+
+    stats.rs_occupancy[rs.entryCount()] += cycles;
+    stats.rrf_occupancy[rrf.entryCount()] += cycles;
+    stats.rob_occupancy[entryCount(&HardwareThread::rob)] += cycles;
+    stats.sb_occupancy[entryCount(&HardwareThread::sb)] += cycles;
+    stats.lq_occupancy[entryCount(&HardwareThread::lq)] += cycles;
+    stats.sq_occupancy[entryCount(&HardwareThread::sq)] += cycles;
+    stats.mshr_occupancy[dcache.outstandingMisses()] += cycles;
+}
+
+// Cycles until the next one that can differ from an idle cycle just simulated: when a
+// functional unit, a miss, a store buffer write or the rename map recovery finishes
+unsigned long Core::cyclesToNextEvent() {
+    unsigned long next = -1UL;
+    for (const IntegerALU &alu : alus)
+        next = std::min(next, alu.nextEvent());
+    for (const LoadUnit &ldu : ldus)
+        next = std::min(next, ldu.nextEvent());
+    for (const StoreUnit &stu : stus)
+        next = std::min(next, stu.nextEvent());
+    next = std::min(next, dcache.nextEvent());
+    for (HardwareThread &t : threads) {
+        if (!t.sb.empty() && t.sb.front().timer > 0)
+            next = std::min(next, (unsigned long)t.sb.front().timer);
+        if (t.recovery_cycles > 0)
+            next = std::min(next, t.recovery_cycles + 1UL);
+    }
+    return next;
 }
 
-int main() {
-    const static std::string config_filename = "input_files/config.txt";
-    const static std::string instruction_filename = "input_files/input.txt";
-    unsigned long cycle = 0;
-    inputConfiguration(config_filename);
-    initialiseMemoryAndARF();
-    fetchDecodeInstructions(instruction_filename);
+// Jumps over cycles that would repeat the idle cycle just simulated. Timers count down
+// by the cycles skipped, and the statistics gain what the idle cycle added to them
+// once per cycle skipped.
+void Core::skipIdleCycles(unsigned long cycles,
+        const std::array<unsigned long, STALL_REASON_COUNT> &stalls_before) {
+    for (IntegerALU &alu : alus)
+        alu.skip(cycles);
+    for (LoadUnit &ldu : ldus)
+        ldu.skip(cycles);
+    for (StoreUnit &stu : stus)
+        stu.skip(cycles);
+    dcache.skip(cycles);
+    for (HardwareThread &t : threads) {
+        if (!t.sb.empty() && t.sb.front().timer > 0)
+            t.sb.front().timer -= cycles;
+        if (t.recovery_cycles > 0)
+            t.recovery_cycles -= cycles;
+    }
+    for (int i=0; i < STALL_REASON_COUNT; ++i)
+        stats.stalls[i] += (stats.stalls[i] - stalls_before[i]) * cycles;
+    sampleCycle(cycles);
+}
+
+void Core::printCycle(unsigned long cycle) {
     std::cout << std::setfill('*') << std::setw(80) << "" << std::endl;
     std::cout << std::setfill(' ') << std::setw(43) << "CYCLE " << cycle << std::endl;
     std::cout << std::setfill('*') << std::setw(80) << "" << std::endl;
-    std::cout << arf << rrf << rs << rob;
+    for (HardwareThread &t : threads) {
+        if (threads.size() > 1)
+            std::cout << "Thread " << t.id << std::endl;
+        std::cout << t.arf;
+    }
+    std::cout << rrf << rs;
+    for (HardwareThread &t : threads) {
+        if (threads.size() > 1)
+            std::cout << "Thread " << t.id << std::endl;
+        std::cout << t.rob;
+    }
+}
+
+// Prints the mean occupancy of a buffer and a histogram of the fraction of cycles it
+// spent at each occupancy, in at most 8 buckets
+void printOccupancy(const std::string &name, const std::vector<unsigned long> &hist,
+        unsigned long cycles) {
+    int size = hist.size() - 1;
+    double mean = 0;
+    for (int i=0; i <= size; ++i)
+        mean += (double)i * hist[i] / cycles;
+    std::cout << name << " occupancy (" << size << " entries): mean "
+        << std::fixed << std::setprecision(2) << mean << std::endl;
+    int width = (size + 8) / 8;
+    for (int lo=0; lo <= size; lo += width) {
+        int hi = std::min(lo + width - 1, size);
+        unsigned long count = 0;
+        for (int i=lo; i <= hi; ++i)
+            count += hist[i];
+        std::string range = (lo == hi) ? std::to_string(lo)
+            : std::to_string(lo) + "-" + std::to_string(hi);
+        std::cout << std::setw(12) << range << std::setw(12) << count
+            << std::setw(8) << 100.0 * count / cycles << "%" << std::endl;
+    }
+}
+
+// Prints the distribution of load latencies in power-of-two buckets and, with data
+// caches, their hit counts and the memory-level parallelism: the mean number of misses
+// in flight over the cycles that had at least one
+void Core::printMemorySummary(unsigned long cycles) {
+    unsigned long loads = 0;
+    double mean = 0;
+    for (size_t i=0; i < stats.load_latency.size(); ++i) {
+        loads += stats.load_latency[i];
+        mean += (double)i * stats.load_latency[i];
+    }
+    std::cout << "Loads issued = " << loads << ", mean latency = "
+        << mean / std::max(loads, 1UL) << " cycles" << std::endl;
+    std::cout << "Loads forwarded from stores = " << stats.forwarded << std::endl;
+    std::cout << "Memory order violations = " << stats.violations << std::endl;
+    for (size_t lo=1; lo < stats.load_latency.size(); lo *= 2) {
+        size_t hi = std::min(2*lo - 1, stats.load_latency.size() - 1);
+        unsigned long count = 0;
+        for (size_t i=lo; i <= hi; ++i)
+            count += stats.load_latency[i];
+        std::string range = (lo == hi) ? std::to_string(lo)
+            : std::to_string(lo) + "-" + std::to_string(hi);
+        std::cout << std::setw(12) << range << std::setw(12) << count
+            << std::setw(8) << 100.0 * count / loads << "%" << std::endl;
+    }
+    if (!dcache.enabled()) {
+        std::cout << std::endl;
+        return;
+    }
+
+    CacheHierarchy &caches = dcache.hierarchy();
+    for (int i=0; i < caches.levelCount(); ++i) {
+        Cache &c = caches.level(i);
+        std::cout << "L" << c.level() << ": hits = " << c.hitCount() << ", misses = "
+            << c.missCount() << " (" << 100.0 * c.missCount() / std::max(c.hitCount() + c.missCount(), 1L)
+            << "%)" << std::endl;
+    }
+    unsigned long miss_cycles = cycles - stats.mshr_occupancy[0];
+    double outstanding = 0;
+    for (size_t i=1; i < stats.mshr_occupancy.size(); ++i)
+        outstanding += (double)i * stats.mshr_occupancy[i];
+    std::cout << "MLP = " << outstanding / std::max(miss_cycles, 1UL) << " over "
+        << miss_cycles << " cycles with misses in flight" << std::endl;
+    printOccupancy("MSHR", stats.mshr_occupancy, cycles);
+    std::cout << std::endl;
+}
+
+void Core::printSummary(unsigned long cycles) {
+    std::cout << std::setfill('=') << std::setw(40) << "" << std::endl;
+    std::cout << std::setfill(' ') << "Summary" << std::endl;
+    std::cout << std::setfill('-') << std::setw(40) << "" << std::endl;
+    std::cout << std::setfill(' ') << std::fixed << std::setprecision(3);
+    std::cout << "Cycles = " << cycles << std::endl;
+    std::cout << "Instructions committed = " << stats.committed << std::endl;
+    std::cout << "IPC = " << (double)stats.committed / cycles << std::endl;
+    if (stats.fast_forwarded)
+        std::cout << "Instructions fast-forwarded = " << stats.fast_forwarded << " in "
+            << stats.functional_intervals << " functional intervals" << std::endl;
+    std::cout << "Conditional branches = " << stats.branches << ", mispredicted = "
+        << stats.mispredictions << " (" << 100.0 * stats.mispredictions / std::max(stats.branches, 1UL)
+        << "%)" << std::endl;
+    std::cout << "Squashed instructions = " << stats.squashed << std::endl;
+    std::cout << "BTB misses = " << stats.btb_misses << std::endl;
+    std::cout << std::endl << "Utilization:" << std::endl;
+    // ALUs are numbered within their type
+    for (size_t i=0, n=0; i < alus.size(); ++i) {
+        n = (i > 0 && alus[i].type() == alus[i-1].type()) ? n + 1 : 0;
+        std::cout << std::setw(12) << alus[i].type()+" "+std::to_string(n)
+            << std::setw(8) << 100.0 * stats.alu_busy[i] / cycles << "%" << std::endl;
+    }
+    // Units of the same type, and the CDBs, are reported together
+    std::cout << std::setw(12) << "Load unit" << std::setw(8) << 100.0 * stats.ldu_busy / (cycles * ldus.size()) << "%" << std::endl;
+    std::cout << std::setw(12) << "Store unit" << std::setw(8) << 100.0 * stats.stu_busy / (cycles * stus.size()) << "%" << std::endl;
+    std::cout << std::setw(12) << "CDB" << std::setw(8) << 100.0 * stats.cdb_busy / (cycles * cdbs.size()) << "%" << std::endl;
+    std::cout << std::setw(12) << "Memory bus" << std::setw(8) << 100.0 * stats.mem_bus_busy / cycles << "%" << std::endl;
+    std::cout << std::endl << "Stall cycles:" << std::endl;
+    for (int i=0; i < STALL_REASON_COUNT; ++i) {
+        std::cout << std::setw(16) << (stall_reason)i << std::setw(12) << stats.stalls[i]
+            << std::setw(8) << 100.0 * stats.stalls[i] / cycles << "%" << std::endl;
+    }
+    std::cout << std::endl;
+    printOccupancy("RS", stats.rs_occupancy, cycles);
+    printOccupancy("ROB", stats.rob_occupancy, cycles);
+    printOccupancy(config.merged_registers ? "PRF" : "RRF", stats.rrf_occupancy, cycles);
+    printOccupancy("Load queue", stats.lq_occupancy, cycles);
+    printOccupancy("Store queue", stats.sq_occupancy, cycles);
+    printOccupancy("Store buffer", stats.sb_occupancy, cycles);
+    std::cout << std::endl;
+    printMemorySummary(cycles);
+}
+
+Core::Core(const MachineConfig &config, const Workload &programs)
+        : config(config), threads(programs.size()) {
+    unsigned n = threads.size();
+    rrf.setSize(config.registerCount(n));
+    rs.setSize(config.rs_size);
+    for (size_t i = 0; i < threads.size(); ++i) {
+        HardwareThread &t = threads[i];
+        t.id = i;
+        t.program = programs[i];
+        t.fetch_buffer.attach(*t.program);
+        t.rob.setSize(config.threadShare(config.rob_size, n));
+        t.sb.setSize(config.threadShare(config.sb_size, n));
+        t.lq.setSize(config.threadShare(config.lq_size, n));
+        t.sq.setSize(config.threadShare(config.sq_size, n));
+        t.checkpoints.assign(config.checkpoints, rename_map());
+        initialiseMemoryAndARF(t);
+        if (config.merged_registers) {
+            // Every architectural register starts out mapped to a physical one
+            for (int r=0; r < t.arf.size(); ++r) {
+                int p = rrf.allocate();
+                rrf[p].valid = true;
+                rrf[p].data = t.arf[r].data;
+                t.arf[r].busy = true;
+                t.arf[r].tag = p;
+                t.retirement_map[r] = p;
+            }
+        }
+    }
+    store_sets.setSize(config.store_set_entries);
+    cdbs.assign(config.cdb_count, bus());
+    if (config.unit_types.empty()) {
+        alus.assign(config.alu_count, IntegerALU(config));
+    } else {
+        for (const unit_type &t : config.unit_types)
+            alus.insert(alus.end(), t.count, IntegerALU(config, t));
+    }
+    ldus.assign(config.load_units, LoadUnit());
+    stus.assign(config.store_units, StoreUnit());
+    if (!config.cache_config.empty())
+        dcache.configure(config.cache_config, config.mshrs);
+    predictor.reset(makePredictor(config.predictor, config.predictor_bits));
+    btb.setSize(config.btb_entries);
+
+    stats.thread_committed.resize(n);
+    stats.thread_cycles.resize(n);
+    stats.alu_busy.resize(alus.size());
+    stats.rs_occupancy.resize(rs.size() + 1);
+    stats.rob_occupancy.resize(config.rob_size + 1);
+    stats.sb_occupancy.resize(config.sb_size + 1);
+    stats.lq_occupancy.resize(config.lq_size + 1);
+    stats.sq_occupancy.resize(config.sq_size + 1);
+    stats.rrf_occupancy.resize(rrf.size() + 1);
+    stats.mshr_occupancy.resize(dcache.mshrCount() + 1);
+}
+
+// Committed value of architectural register r of thread t. Only valid when nothing of
+// the thread is in flight.
+int Core::registerValue(HardwareThread &t, int r) {
+    return config.merged_registers ? rrf[t.retirement_map[r]].data : t.arf[r].data;
+}
+
+void Core::setRegisterValue(HardwareThread &t, int r, int value) {
+    t.arf[r].data = value;
+    if (config.merged_registers)
+        rrf[t.retirement_map[r]].data = value;
+}
+
+// Runs up to count instructions of the correct path of thread t on the functional
+// model, which updates its registers and memory without modelling time. Its
+// pipeline must be empty. With warming, loads and stores access the caches and
+// branches train the predictor and the BTB as they would at commit. Returns the
+// instructions run.
+unsigned long Core::fastForward(HardwareThread &t, unsigned long count) {
+    unsigned long n = 0;
+    for (; n < count && t.fetch_pc < t.program->size(); ++n) {
+        const instruction &instn = t.fetch_buffer.fetch(t.fetch_pc);
+        int op[MAX_ARITY];
+        for (int i = 0; i < arity[instn.op]; ++i)
+            op[i] = instn.src[i].is_imm ? instn.src[i].field : registerValue(t, instn.src[i].field);
+        ++t.fetch_pc;
+        if (isALUOperation(instn.op)) {
+            setRegisterValue(t, instn.dest_arf_index, IntegerALU::computeResult(op[0], op[1], instn.op));
+        } else if (isLoad(instn.op)) {
+            setRegisterValue(t, instn.dest_arf_index, t.memory.read(op[0]));
+            if (config.functional_warming)
+                dcache.warm(cacheAddress(t, op[0]), false);
+        } else if (isStore(instn.op)) {
+            t.memory.write(op[0], op[1]);
+            if (config.functional_warming)
+                dcache.warm(cacheAddress(t, op[0]), true);
+        } else {
+            bool taken = instn.op == JMP || IntegerALU::computeResult(op[0], op[1], instn.op);
+            if (isConditionalBranch(instn.op)) {
+                if (config.functional_warming)
+                    predictor->update(instn.addr, t.global_history, taken);
+                t.global_history = t.global_history << 1 | taken;
+            }
+            if (taken) {
+                if (config.functional_warming)
+                    btb.insert(instn.addr, instn.target);
+                t.fetch_pc = instn.target;
+            }
+        }
+    }
+    t.committed_pc = t.fetch_pc;
+    t.committed_history = t.global_history;
+    stats.fast_forwarded += n;
+    return n;
+}
+
+// Removes every instruction of thread t that has not committed, to switch to the
+// functional model, and sends fetch down the correct path after the last committed
+// one. These instructions are not counted as squashed.
+void Core::flushPipeline(HardwareThread &t) {
+    unsigned long squashed = squashYoungerThan(t, t.committed_seq);
+    stats.squashed -= squashed;
+    walkRenameMap(t, 0);
+    t.global_history = t.committed_history;
+    t.fetch_pc = t.committed_pc;
+    t.btb_bubble = false;
+}
+
+// Runs every thread's program to completion, printing the state for the cycles in
+// [first_dump, last_dump]. Returns the number of cycles taken, which only counts the
+// cycles simulated in detail.
+unsigned long Core::simulate(unsigned long first_dump, unsigned long last_dump) {
+    cycle = 0;
+    if (config.fast_forward) {
+        for (HardwareThread &t : threads)
+            fastForward(t, config.fast_forward);
+        stats.functional_intervals++;
+    }
+    // Number of committed instructions at which the detailed interval ends
+    unsigned long interval_end = config.detailed_interval ? config.detailed_interval : -1UL;
+    // Set while the store buffers drain at the end of a detailed interval
+    bool draining = false;
+    bool running = true;
+    if (cycle >= first_dump && cycle <= last_dump)
+        printCycle(cycle);
     do {
         ++cycle;
-        for (unsigned i=0; i < IPC && !instn_buffer.empty(); ++i) {
-            instruction instn = instn_buffer.front();
-            try {
-                dispatch(instn);
-                instn_buffer.pop();
-            } catch (buffer_overflow_error e) {
-                break;
-            }
+        unsigned long progress_before = progress;
+        std::array<unsigned long, STALL_REASON_COUNT> stalls_before = stats.stalls;
+        bool bubble = false, recovered = false;
+        for (const HardwareThread &t : threads) {
+            bubble = bubble || t.btb_bubble;
+            recovered = recovered || t.recovery_cycles == 1;
         }
+        fetchStage(draining);
         execute();
         complete();
-	retire();
-        
-        std::cout << std::setfill('*') << std::setw(80) << "" << std::endl;
-        std::cout << std::setfill(' ') << std::setw(43) << "CYCLE " << cycle << std::endl;
-        std::cout << std::setfill('*') << std::setw(80) << "" << std::endl;
-        std::cout << arf << rrf << rs << rob;
-    } while (!rob.empty() || !sb.empty());
+        // The store buffers take turns at the memory bus
+        bool bus_taken = false;
+        for (size_t i = 0; i < threads.size(); ++i)
+            bus_taken = retire(threads[(cycle + i) % threads.size()], bus_taken) || bus_taken;
+        sampleCycle();
+
+        if (cycle >= first_dump && cycle <= last_dump)
+            printCycle(cycle);
+
+        // The cycles up to the next event would be the same as this one if nothing
+        // happened in it, so they are skipped unless one of them is to be printed.
+        // Fetch does something else after a BTB bubble or the last recovery cycle.
+        if (config.skip_idle && progress == progress_before && !bubble && !recovered) {
+            unsigned long skip = cyclesToNextEvent();
+            skip = (skip == -1UL) ? 0 : skip - 1;
+            if (skip > 0 && first_dump <= cycle + skip && last_dump > cycle)
+                skip = (first_dump > cycle) ? first_dump - cycle - 1 : 0;
+            if (skip > 0) {
+                skipIdleCycles(skip, stalls_before);
+                cycle += skip;
+            }
+        }
+
+        bool drained = true;
+        for (HardwareThread &t : threads)
+            drained = drained && t.sb.empty();
+        if (!draining && stats.committed >= interval_end) {
+            for (HardwareThread &t : threads)
+                flushPipeline(t);
+            draining = true;
+        }
+        if (draining && drained) {
+            if (!config.functional_interval)
+                break;
+            draining = false;
+            for (HardwareThread &t : threads)
+                fastForward(t, config.functional_interval);
+            stats.functional_intervals++;
+            interval_end = stats.committed + config.detailed_interval;
+        }
+
+        running = false;
+        for (HardwareThread &t : threads) {
+            if (!t.finished())
+                running = true;
+            else if (!stats.thread_cycles[t.id])
+                stats.thread_cycles[t.id] = cycle;
+        }
+    } while (running);
+    return cycle;
+}
+
+// Outcome of a run on one configuration
+struct run_result {
+    unsigned long cycles;
+    Statistics stats;
+};
+
+// Runs workload i on configuration i for every i, each on its own core, with up to
+// threads of them at a time. The results are in the order of the configurations.
+std::vector<run_result> runCores(const std::vector<MachineConfig> &configs,
+        const std::vector<Workload> &workloads, unsigned threads) {
+    std::vector<run_result> results(configs.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&] () {
+        for (size_t i = next++; i < configs.size(); i = next++) {
+            Core core(configs[i], workloads[i]);
+            results[i].cycles = core.simulate(-1UL, 0);
+            results[i].stats = core.stats;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < std::min<size_t>(threads, configs.size()); ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (std::thread &t : pool)
+        t.join();
+    return results;
+}
+
+// Runs the workload on every configuration
+std::vector<run_result> runConfigurations(const std::vector<MachineConfig> &configs,
+        const Workload &workload, unsigned threads) {
+    return runCores(configs, std::vector<Workload>(configs.size(), workload), threads);
+}
+
+// Prints the IPC of each hardware thread next to its IPC when it runs alone on the
+// same machine. The ratio of the two is the progress the thread makes under SMT; the
+// weighted speedup is their sum and the fairness the lowest over the highest. A
+// thread's IPC is taken over the cycles until it finished.
+void printThreadSummary(const MachineConfig &config, const Workload &workload,
+        const Statistics &stats, unsigned long cycles, unsigned threads) {
+    std::vector<Workload> alone;
+    for (const ProgramImage *program : workload)
+        alone.push_back(Workload(1, program));
+    std::vector<run_result> results = runCores(
+            std::vector<MachineConfig>(workload.size(), config), alone, threads);
+
+    std::cout << std::setfill('=') << std::setw(56) << "" << std::endl;
+    std::cout << std::setfill(' ') << "Hardware threads (fetch policy " << config.fetch_policy
+        << ", " << (config.shared_buffers ? "shared" : "partitioned") << " buffers)" << std::endl;
+    std::cout << std::setfill('-') << std::setw(56) << "" << std::endl;
+    std::cout << std::setfill(' ') << std::setw(8) << "Thread" << std::setw(12) << "Committed"
+        << std::setw(12) << "Cycles" << std::setw(8) << "IPC" << std::setw(8) << "Alone"
+        << std::setw(8) << "Ratio" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    double weighted = 0, lowest = -1, highest = 0;
+    for (size_t i = 0; i < workload.size(); ++i) {
+        unsigned long thread_cycles = stats.thread_cycles[i] ? stats.thread_cycles[i] : cycles;
+        double ipc = (double)stats.thread_committed[i] / thread_cycles;
+        double alone_ipc = (double)results[i].stats.committed / results[i].cycles;
+        double ratio = ipc / alone_ipc;
+        weighted += ratio;
+        lowest = (lowest < 0) ? ratio : std::min(lowest, ratio);
+        highest = std::max(highest, ratio);
+        std::cout << std::setw(8) << i << std::setw(12) << stats.thread_committed[i]
+            << std::setw(12) << thread_cycles << std::setw(8) << ipc
+            << std::setw(8) << alone_ipc << std::setw(8) << ratio << std::endl;
+    }
+    std::cout << "Weighted speedup = " << weighted << std::endl;
+    std::cout << "Fairness = " << lowest / highest << std::endl << std::endl;
+}
+
+// Runs the workload again while varying one width at a time around the configuration,
+// and with all of dispatch, issue, CDB and commit widths set to the same value, and
+// prints the IPC of each run
+void printSensitivity(const MachineConfig &base, const Workload &workload,
+        unsigned threads) {
+    static const unsigned widths[] = { 1, 2, 4, 8 };
+    struct parameter {
+        const char *name;
+        unsigned MachineConfig::*field;
+    } parameters[] = {
+        { "Dispatch width", &MachineConfig::dispatch_width },
+        { "Issue width", &MachineConfig::issue_width },
+        { "CDBs", &MachineConfig::cdb_count },
+        { "Commit width", &MachineConfig::commit_width },
+        { "ALUs", &MachineConfig::alu_count },
+        { "Load units", &MachineConfig::load_units },
+        { "Store units", &MachineConfig::store_units },
+    };
+
+    std::vector<MachineConfig> configs;
+    for (const parameter &p : parameters) {
+        for (unsigned w : widths) {
+            MachineConfig config = base;
+            config.*p.field = w;
+            // With declared unit types, the ALU count applies to each of them
+            if (p.field == &MachineConfig::alu_count)
+                for (unit_type &t : config.unit_types)
+                    t.count = w;
+            configs.push_back(config);
+        }
+    }
+    for (unsigned w : widths) {
+        MachineConfig config = base;
+        config.dispatch_width = config.issue_width = config.cdb_count = config.commit_width = w;
+        configs.push_back(config);
+    }
+    std::vector<run_result> results = runConfigurations(configs, workload, threads);
+
+    std::cout << std::setfill('=') << std::setw(56) << "" << std::endl;
+    std::cout << std::setfill(' ') << "IPC sensitivity" << std::endl;
+    std::cout << "Base: dispatch " << base.dispatch_width << ", issue " << base.issueWidth()
+        << ", CDBs " << base.cdb_count << ", commit " << base.commit_width
+        << ", ALUs " << base.aluCount() << ", load units " << base.load_units
+        << ", store units " << base.store_units << std::endl;
+    std::cout << std::setfill('-') << std::setw(56) << "" << std::endl;
+    std::cout << std::setfill(' ') << std::setw(16) << "";
+    for (unsigned w : widths)
+        std::cout << std::setw(10) << w;
+    std::cout << std::endl << std::fixed << std::setprecision(3);
+
+    size_t run = 0;
+    for (const parameter &p : parameters) {
+        std::cout << std::setw(16) << p.name;
+        for (size_t i=0; i < sizeof(widths)/sizeof(widths[0]); ++i, ++run)
+            std::cout << std::setw(10) << (double)results[run].stats.committed / results[run].cycles;
+        std::cout << std::endl;
+    }
+    std::cout << std::setw(16) << "All widths";
+    for (size_t i=0; i < sizeof(widths)/sizeof(widths[0]); ++i, ++run)
+        std::cout << std::setw(10) << (double)results[run].stats.committed / results[run].cycles;
+    std::cout << std::endl << std::endl;
+}
+
+// A setting of a sweep and the values it takes
+struct sweep_parameter {
+    std::string key;
+    std::vector<std::string> values;
+};
+
+// Reads a sweep file: lines "name = value, value, ..." naming any setting of
+// config.txt and the values to try. Every value is checked against the base
+// configuration before anything runs.
+std::vector<sweep_parameter> readSweep(const std::string &sweep_filename, const MachineConfig &base) {
+    std::ifstream fin(sweep_filename);
+    if (!fin) {
+        std::cerr << "Cannot open " << sweep_filename << std::endl;
+        std::exit(1);
+    }
+    std::vector<sweep_parameter> sweep;
+    std::string line, list, value;
+    while (std::getline(fin, line)) {
+        sweep_parameter p;
+        if (!splitSetting(line.c_str(), p.key, list)) {
+            if (line.find_first_not_of(" \t\r") != std::string::npos)
+                configError(sweep_filename, "expected \"name = value, value, ...\": " + line);
+            continue;
+        }
+        std::istringstream values(list);
+        while (std::getline(values, value, ',')) {
+            value.erase(0, value.find_first_not_of(" \t"));
+            value.erase(value.find_last_not_of(" \t\r") + 1);
+            if (value.empty())
+                configError(sweep_filename, "empty value for " + p.key);
+            MachineConfig config = base;
+            applySetting(config, p.key, value, sweep_filename);
+            p.values.push_back(value);
+        }
+        if (p.values.empty())
+            configError(sweep_filename, "no values for " + p.key);
+        sweep.push_back(p);
+    }
+    if (sweep.empty())
+        configError(sweep_filename, "nothing to sweep");
+    return sweep;
+}
+
+// Runs the workload on every combination of the values in the sweep file and prints a
+// table with a row per configuration, the first setting varying slowest
+void runSweep(const std::string &sweep_filename, const MachineConfig &base,
+        const Workload &workload, unsigned threads) {
+    std::vector<sweep_parameter> sweep = readSweep(sweep_filename, base);
+    size_t points = 1;
+    for (const sweep_parameter &p : sweep)
+        points *= p.values.size();
+
+    std::vector<MachineConfig> configs;
+    std::vector<std::vector<size_t>> choices;
+    for (size_t n = 0; n < points; ++n) {
+        MachineConfig config = base;
+        std::vector<size_t> choice(sweep.size());
+        for (size_t i = sweep.size(), rest = n; i-- > 0; rest /= sweep[i].values.size())
+            choice[i] = rest % sweep[i].values.size();
+        for (size_t i = 0; i < sweep.size(); ++i)
+            applySetting(config, sweep[i].key, sweep[i].values[choice[i]], sweep_filename);
+        checkConfiguration(config, sweep_filename);
+        checkThreads(config, workload.size(), sweep_filename);
+        configs.push_back(config);
+        choices.push_back(choice);
+    }
+    std::vector<run_result> results = runConfigurations(configs, workload, threads);
+
+    // A column per setting, as wide as its name or its widest value
+    std::vector<size_t> widths;
+    for (const sweep_parameter &p : sweep) {
+        size_t w = p.key.size();
+        for (const std::string &v : p.values)
+            w = std::max(w, v.size());
+        widths.push_back(w + 2);
+    }
+    std::cout << std::setfill(' ');
+    for (size_t i = 0; i < sweep.size(); ++i)
+        std::cout << std::setw(widths[i]) << sweep[i].key;
+    std::cout << std::setw(12) << "Cycles" << std::setw(12) << "Committed"
+        << std::setw(8) << "IPC" << std::setw(12) << "Mispredicts"
+        << std::setw(12) << "Violations" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (size_t n = 0; n < points; ++n) {
+        for (size_t i = 0; i < sweep.size(); ++i)
+            std::cout << std::setw(widths[i]) << sweep[i].values[choices[n][i]];
+        const run_result &r = results[n];
+        std::cout << std::setw(12) << r.cycles << std::setw(12) << r.stats.committed
+            << std::setw(8) << (double)r.stats.committed / r.cycles
+            << std::setw(12) << r.stats.mispredictions
+            << std::setw(12) << r.stats.violations << std::endl;
+    }
+}
+
+// ooo_bench.cpp includes this file for the simulator alone
+#ifndef OUTOFORDER_NO_MAIN
+void usage(const char *prog) {
+    std::cerr << "USAGE:- " << prog << " [-q | -s | -S SWEEP_FILE] [-j THREADS] [-w FIRST:LAST] [-t TRACE_FILE] [config_file [instruction_file ...]]" << std::endl
+        << "  -q              print only the summary at the end of the run" << std::endl
+        << "  -s              print the IPC of the program for a range of widths and unit counts" << std::endl
+        << "  -S SWEEP_FILE   run every combination of the settings in SWEEP_FILE and print a table" << std::endl
+        << "  -j THREADS      runs of -s and -S done at once (default: one per processor)" << std::endl
+        << "  -w FIRST:LAST   also print the state of the machine for cycles FIRST to LAST" << std::endl
+        << "  -t TRACE_FILE   write the timeline of every instruction to TRACE_FILE (see pipeview)" << std::endl
+        << "Without -q or -w the state is printed for every cycle. With several instruction" << std::endl
+        << "files, up to " << MAX_THREADS << ", each runs on its own hardware thread of the core." << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    std::string config_filename = "input_files/config.txt";
+    std::vector<std::string> instruction_filenames;
+    std::string sweep_filename;
+    std::string trace_filename;
+
+    // Cycles whose state is printed. By default, all of them.
+    unsigned long first_dump = 0, last_dump = -1UL;
+    bool sensitivity = false;
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+    int opt;
+    while ((opt = getopt(argc, argv, "qsS:j:w:t:")) != -1) {
+        switch (opt) {
+            case 's':
+                sensitivity = true;
+                break;
+            case 'S':
+                sweep_filename = optarg;
+                break;
+            case 't':
+                trace_filename = optarg;
+                break;
+            case 'j':
+                if (sscanf(optarg, "%u", &threads) != 1 || threads == 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'q':
+                first_dump = -1UL;
+                last_dump = 0;
+                break;
+            case 'w':
+                if (sscanf(optarg, "%lu:%lu", &first_dump, &last_dump) != 2) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind < argc)
+        config_filename = argv[optind++];
+    while (optind < argc)
+        instruction_filenames.push_back(argv[optind++]);
+    if (instruction_filenames.empty())
+        instruction_filenames.push_back("input_files/input.txt");
+    if (instruction_filenames.size() > MAX_THREADS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    MachineConfig config;
+    inputConfiguration(config_filename, config);
+    checkThreads(config, instruction_filenames.size(), config_filename);
+    std::vector<std::unique_ptr<ProgramImage>> programs;
+    Workload workload;
+    for (const std::string &filename : instruction_filenames) {
+        programs.emplace_back(new ProgramImage);
+        programs.back()->load(filename);
+        workload.push_back(programs.back().get());
+    }
+    if (!sweep_filename.empty()) {
+        runSweep(sweep_filename, config, workload, threads);
+        return 0;
+    }
+    if (sensitivity) {
+        printSensitivity(config, workload, threads);
+        return 0;
+    }
+    Core core(config, workload);
+    TimelineWriter trace;
+    if (!trace_filename.empty()) {
+        if (!trace.open(trace_filename)) {
+            std::cerr << "Cannot write " << trace_filename << std::endl;
+            return 1;
+        }
+        core.timeline_writer = &trace;
+    }
+    unsigned long cycle = core.simulate(first_dump, last_dump);
     std::cout << "Total number of cycles = " << cycle << std::endl;
-    std::cout << arf;
+    for (HardwareThread &t : core.threads) {
+        if (core.threads.size() > 1)
+            std::cout << "Thread " << t.id << std::endl;
+        std::cout << t.arf;
+    }
+    core.printSummary(cycle);
+    if (workload.size() > 1)
+        printThreadSummary(config, workload, core.stats, cycle, threads);
     //std::cout << memory[99] << std::endl;
     return 0;
 }
+#endif
@@ -1,33 +1,90 @@
 #include <vector>
 #include <array>
 #include <queue>
+#include <deque>
+#include <string>
 #include <iostream>
 #include <iomanip>
 #include <unordered_set>
+#include <unordered_map>
 #include <algorithm>
+#include <memory>
 #include <stdlib.h>
+#include <limits.h>
+#include <stdint.h>
+#include "branch_predictor.hpp"
+#include "store_sets.hpp"
+#include "program.hpp"
+#include "timeline.hpp"
+#include "../Assignment 2/cache_model.h"
 
-#define ARF_SIZE 8
-#define RRF_SIZE 8
-#define MEM_SIZE 100
-#define MAX_ARITY 2
-#define ALU_COUNT 2
+#define RRF_SIZE 8      // default, the size can be set in config.txt
 
-class buffer_overflow_error : std::runtime_error {
-    public:
-        buffer_overflow_error(const std::string& what_arg) : runtime_error(what_arg) {}
+// Reasons for a stall in a cycle. Dispatch reports the first of RRF_FULL, RS_FULL,
+// ROB_FULL, LQ_FULL and SQ_FULL that stops it; the others are found by the stage they
+// hold up. While the rename map is rebuilt after a misprediction or a memory order
+// violation, or fetch waits for the target of a taken branch that missed in the BTB,
+// nothing is dispatched. LOAD_PENDING is a load at the
+// ROB head that has not got its value, and MEM_DEPENDENCE a load held back by an older
+// store it is predicted to depend on.
+enum stall_reason {
+    NO_STALL = -1,
+    RRF_FULL, RS_FULL, ROB_FULL, LQ_FULL, SQ_FULL, SB_FULL,
+    NO_FREE_ALU, CDB_CONFLICT, MEM_BUS_BUSY, MSHR_FULL, MEM_DEPENDENCE, LOAD_PENDING,
+    RENAME_RECOVERY, BTB_MISS,
+    STALL_REASON_COUNT
+};
+
+std::ostream& operator<< (std::ostream& out, stall_reason reason) {
+    switch (reason) {
+        case RRF_FULL:     out << "RRF full"; break;
+        case RS_FULL:      out << "RS full"; break;
+        case ROB_FULL:     out << "ROB full"; break;
+        case LQ_FULL:      out << "LQ full"; break;
+        case SQ_FULL:      out << "SQ full"; break;
+        case SB_FULL:      out << "SB full"; break;
+        case NO_FREE_ALU:  out << "No free ALU"; break;
+        case CDB_CONFLICT: out << "CDB conflict"; break;
+        case MEM_BUS_BUSY: out << "Memory bus busy"; break;
+        case MSHR_FULL:    out << "MSHRs full"; break;
+        case MEM_DEPENDENCE: out << "Mem dependence"; break;
+        case LOAD_PENDING: out << "Load pending"; break;
+        case RENAME_RECOVERY: out << "Rename recovery"; break;
+        case BTB_MISS:     out << "BTB miss"; break;
+        default:           out << "None"; break;
+    }
+    return out;
+}
+
+// When loads go ahead of older stores with unknown addresses: STORE_SETS when the
+// predictor expects no conflict, SPECULATIVE always, CONSERVATIVE never
+enum disambiguation_policy {
+    STORE_SETS, SPECULATIVE, CONSERVATIVE
 };
 
+// Which hardware thread fetches in a cycle: ICOUNT the one with the fewest instructions
+// waiting to issue, ROUND_ROBIN each in turn
+enum thread_fetch_policy {
+    ICOUNT, ROUND_ROBIN
+};
+
+std::ostream& operator<< (std::ostream& out, thread_fetch_policy policy) {
+    out << (policy == ICOUNT ? "icount" : "round-robin");
+    return out;
+}
+
 //class buffer_underflow_error : std::runtime_error {
     //public:
         //buffer_underflow_error(const std::string& what_arg) : runtime_error(what_arg) {}
 //};
 
 struct bus {
-    bool busy;
-    int tag;
-    int data;
-} cdb, mem_bus;
+    bool busy = false;
+    int tag = 0;
+    int data = 0;
+    unsigned long seq = 0;  // instruction that produced the data
+    int thread = 0;         // hardware thread of that instruction
+};
 
 struct arf_entry {
     bool busy;
@@ -51,11 +108,13 @@ class ArchitectedRegisterFile {
     void initialise() {
         for (size_t i = 0;i<_arf.size();i++)
         {
+            _arf[i].busy = false;
+            _arf[i].tag = 0;
             _arf[i].data = 1; 
         }
     }
     friend std::ostream& operator<< (std::ostream&, ArchitectedRegisterFile&);
-} arf;
+};
 
 std::ostream& operator<< (std::ostream& out, ArchitectedRegisterFile& arf) {
     out << std::setfill('=') << std::setw(25) << "" << std::endl;
@@ -85,19 +144,60 @@ struct rrf_entry {
     int data;
 };
 
-class RenameRegisterFile {
-    std::array<rrf_entry, RRF_SIZE> _rrf;
-    int _tail = 0;
-    int find_free_entry() {
-        auto e = std::find_if_not(
-                _rrf.cbegin(), _rrf.cend(),
-                [] (rrf_entry re) {
-                return re.busy;
-                } );
-        return e - _rrf.cbegin();
+// Free entries of a buffer kept as a bitmap. Allocation takes the lowest free entry,
+// found with a count of trailing zeros starting from the lowest word that may have one.
+class FreeList {
+    std::vector<uint64_t> _free;
+    size_t _count = 0;
+    size_t _first_word = 0; // every word below this one is fully allocated
+
+    public:
+    void setSize(size_t sz) {
+        _free.assign((sz + 63) / 64, 0);
+        for (size_t i=0; i < sz; ++i)
+            _free[i/64] |= 1ULL << (i%64);
+        _count = sz;
+        _first_word = 0;
+    }
+    bool empty() const {
+        return _count == 0;
+    }
+    size_t freeCount() const {
+        return _count;
+    }
+    // Lowest free entry, without allocating it. Only valid if the list is not empty.
+    size_t lowest() {
+        while (_free[_first_word] == 0)
+            ++_first_word;
+        return _first_word*64 + __builtin_ctzll(_free[_first_word]);
+    }
+    size_t allocate() {
+        size_t i = lowest();
+        _free[i/64] &= ~(1ULL << (i%64));
+        --_count;
+        return i;
+    }
+    void release(size_t i) {
+        _free[i/64] |= 1ULL << (i%64);
+        ++_count;
+        _first_word = std::min(_first_word, i/64);
     }
+};
+
+// Rename registers holding results until they commit to the ARF or, with a merged
+// register file, the physical registers that hold every value, committed or not
+class RenameRegisterFile {
+    std::vector<rrf_entry> _rrf;
+    FreeList _free;
 
     public:
+    RenameRegisterFile() {
+        setSize(RRF_SIZE);
+    }
+    void setSize(size_t sz) {
+        _rrf.assign(sz, rrf_entry());
+        _free.setSize(sz);
+    }
     rrf_entry& operator[] (size_t i) {
         return _rrf[i];
     }
@@ -107,26 +207,75 @@ class RenameRegisterFile {
     int size() {
         return _rrf.size();
     }
-    bool full() {
-        _tail = find_free_entry();
-        return _tail == size();
+    int entryCount() {
+        return size() - _free.freeCount();
     }
-    int nextIndex() {
-        return _tail;
+    bool full() const {
+        return _free.empty();
     }
-    void push(const rrf_entry &re) {
-        _rrf[_tail] = re;
-        _tail = find_free_entry();
+    // Marks the lowest free rename register busy and returns its index
+    int allocate() {
+        int i = _free.allocate();
+        _rrf[i].busy = true;
+        return i;
     }
     void pop(size_t i) {
         _rrf[i].busy = false;
         _rrf[i].valid = false;
         _rrf[i].data = 0;
+        _free.release(i);
     }
     friend std::ostream& operator<< (std::ostream&, RenameRegisterFile&);
-} rrf;
+};
 
-std::array<unsigned, MEM_SIZE> memory;
+// Data memory of 2^32 words. Pages are allocated when they are first written, so the
+// memory used grows with the part of the address space a program touches. A word that
+// was never written reads as 1.
+class DataMemory {
+    static const unsigned PAGE_BITS = 6;     // 64-word pages suit scattered accesses
+    static const unsigned INITIAL_VALUE = 1;
+    std::unordered_map<unsigned, std::vector<unsigned>> _pages;
+    // The page accessed last, as programs mostly stay within a page
+    unsigned _last_page = 0;
+    std::vector<unsigned> *_last = NULL;
+
+    std::vector<unsigned>* page(unsigned addr) {
+        unsigned number = addr >> PAGE_BITS;
+        if (_last && _last_page == number)
+            return _last;
+        auto p = _pages.find(number);
+        if (p == _pages.end())
+            return NULL;
+        _last_page = number;
+        _last = &p->second;
+        return _last;
+    }
+
+    public:
+    unsigned read(unsigned addr) {
+        std::vector<unsigned> *p = page(addr);
+        return p ? (*p)[addr & ((1u << PAGE_BITS) - 1)] : INITIAL_VALUE;
+    }
+    void write(unsigned addr, unsigned data) {
+        std::vector<unsigned> *p = page(addr);
+        if (!p) {
+            _last_page = addr >> PAGE_BITS;
+            _last = &_pages[_last_page];
+            _last->assign(1u << PAGE_BITS, INITIAL_VALUE);
+            p = _last;
+        }
+        (*p)[addr & ((1u << PAGE_BITS) - 1)] = data;
+    }
+    void clear() {
+        _pages.clear();
+        _last = NULL;
+    }
+    size_t pageCount() const {
+        return _pages.size();
+    }
+};
+const unsigned DataMemory::PAGE_BITS;
+const unsigned DataMemory::INITIAL_VALUE;
 
 std::ostream& operator<< (std::ostream& out, RenameRegisterFile& rrf) {
     out << std::setfill('=') << std::setw(25) << "" << std::endl;
@@ -147,33 +296,6 @@ std::ostream& operator<< (std::ostream& out, RenameRegisterFile& rrf) {
     return out;
 }
 
-enum operation_type {
-    INVALID = -1,
-    ADD, SUB, MUL, DIV, AND, OR, XOR,
-    LD, ST
-};
-
-std::ostream& operator<< (std::ostream& out, operation_type op) {
-    switch (op) {
-        case ADD: out << "ADD"; break;
-        case SUB: out << "SUB"; break;
-        case MUL: out << "MUL"; break;
-        case DIV: out << "DIV"; break;
-        case AND: out << "AND"; break;
-        case OR:  out << "OR"; break;
-        case XOR: out << "XOR"; break;
-        case LD:  out << "LD"; break;
-        case ST:  out << "ST"; break;
-        default:  out << "INVALID";
-    }
-    return out;
-}
-
-int arity[] = {
-    2, 2, 2, 2, 2, 2, 2,
-    1, 2
-};
-
 struct rs_entry {
     struct op_info {
         bool ready = false;
@@ -184,6 +306,10 @@ struct rs_entry {
     std::array<op_info, MAX_ARITY> src;
     int dest;
     operation_type op_type = INVALID;
+    unsigned long seq;      // dispatch order
+    int thread = 0;         // hardware thread, whose ROB and LSQ the indices refer to
+    int rob_index;
+    int lsq_index = -1;     // load or store queue entry of a load or store
     //int exec_unit;
     //bool issued;
     bool all_ops_ready() {
@@ -196,18 +322,64 @@ struct rs_entry {
     }
 };
 
+// Operand slot of a reservation station entry waiting for a tag to be broadcast
+struct rs_operand {
+    size_t index;
+    int operand;
+};
+
 class ReservationStation {
-    static unsigned _last_q_pos;
+    // Sets of entries are bitmasks, one bit per entry
+    typedef std::vector<uint64_t> bitmask;
 
     std::vector<rs_entry> _rs;
-    std::vector<unsigned> _q_pos;
-    int _tail = 0;
+    FreeList _free;
+    // Entries are also given age slots in the order they are allocated, so that the
+    // bitmasks indexed by slot list them from oldest to youngest. Slots are handed out
+    // upwards; when they run out, the busy entries are moved down to the lowest ones.
+    // There are twice as many slots as entries, so that happens at most once every
+    // size() allocations.
+    size_t _slots = 0;
+    size_t _next_slot = 0;
+    std::vector<size_t> _slot;      // age slot of each entry
+    std::vector<size_t> _entry;     // entry in each age slot
+    bitmask _busy;                  // by age slot
+    bitmask _ready;                 // by age slot, busy entries whose operands are all ready
+    // Consumer lists: the operands waiting for each tag
+    std::vector<std::vector<rs_operand>> _waiting;
 
-    size_t find_free_entry() {
-        auto e = std::find_if_not(
-                _rs.cbegin(), _rs.cend(),
-                [] (rs_entry re) { return re.busy; } );
-        return e - _rs.cbegin();
+    static void set(bitmask &m, size_t i) { m[i/64] |= 1ULL << (i%64); }
+    static void clear(bitmask &m, size_t i) { m[i/64] &= ~(1ULL << (i%64)); }
+
+    // The entry in the first slot of m from slot onwards, size() if there is none
+    size_t first(const bitmask &m, size_t slot) const {
+        for (size_t w = slot/64; w < m.size(); ++w) {
+            uint64_t bits = m[w];
+            if (w == slot/64)
+                bits &= ~0ULL << (slot%64);
+            if (bits)
+                return _entry[w*64 + __builtin_ctzll(bits)];
+        }
+        return _rs.size();
+    }
+    // Moves the busy entries to the lowest slots, keeping their order
+    void compact() {
+        bitmask busy(_busy.size(), 0), ready(_ready.size(), 0);
+        size_t next = 0;
+        for (size_t w = 0; w < _busy.size(); ++w) {
+            for (uint64_t bits = _busy[w]; bits; bits &= bits - 1) {
+                size_t slot = w*64 + __builtin_ctzll(bits), i = _entry[slot];
+                _slot[i] = next;
+                _entry[next] = i;
+                set(busy, next);
+                if ((_ready[w] >> (slot%64)) & 1)
+                    set(ready, next);
+                next++;
+            }
+        }
+        _busy.swap(busy);
+        _ready.swap(ready);
+        _next_slot = next;
     }
 
     public:
@@ -222,21 +394,42 @@ class ReservationStation {
     }
     void setSize(size_t sz) {
         _rs.resize(sz);
-        _q_pos.resize(sz);
-        for (size_t i = 0; i < sz; ++i)
-            _q_pos[i] = 0;
+        _free.setSize(sz);
+        _slots = (2*sz + 63) / 64 * 64;
+        _next_slot = 0;
+        _slot.assign(sz, 0);
+        _entry.assign(_slots, 0);
+        _busy.assign(_slots / 64, 0);
+        _ready.assign(_slots / 64, 0);
     }
-    bool full() {
-        _tail = find_free_entry();
-        return _tail == size();
+    int entryCount() {
+        return size() - _free.freeCount();
+    }
+    bool full() const {
+        return _free.empty();
     }
     void push(const rs_entry &re) {
-        _rs[_tail] = re;
-        _rs[_tail].busy = true;
-        _q_pos[_tail] = _last_q_pos++;
-        _tail = find_free_entry();
+        size_t index = _free.allocate();
+        _rs[index] = re;
+        _rs[index].busy = true;
+        if (_next_slot == _slots)
+            compact();
+        size_t slot = _next_slot++;
+        _slot[index] = slot;
+        _entry[slot] = index;
+        set(_busy, slot);
+        if (_rs[index].all_ops_ready())
+            set(_ready, slot);
+        for (int i=0; i < arity[re.op_type]; ++i) {
+            if (re.src[i].ready) continue;
+            size_t tag = re.src[i].field;
+            if (tag >= _waiting.size())
+                _waiting.resize(tag + 1);
+            _waiting[tag].push_back(rs_operand{index, i});
+        }
     }
     void pop(size_t index) {
+        _free.release(index);
         _rs[index].busy = false;
         for (int i=0; i < MAX_ARITY; ++i) {
             _rs[index].src[i].ready = false;
@@ -245,28 +438,37 @@ class ReservationStation {
         _rs[index].dest = 0;
         _rs[index].addr = 0;
         _rs[index].op_type = INVALID;
-        for (size_t i = 0; i < _q_pos.size(); ++i) {
-            if (_q_pos[i] > _q_pos[index])
-                _q_pos[i]--;
-        }
-        _q_pos[index] = 0;
-        _last_q_pos--;
-    }
-    std::vector<size_t> indices_in_q_order() {
-        std::vector<size_t> indices;
-        for (size_t i = 0; i < _rs.size(); ++i) {
-            if (_rs[i].busy)
-                indices.push_back(i);
+        clear(_busy, _slot[index]);
+        clear(_ready, _slot[index]);
+    }
+    // Delivers the value of tag to the operands waiting for it. Entries that left the
+    // station before the broadcast are skipped, as are slots since reused for an
+    // operand waiting for another tag.
+    void wakeup(int tag, int data) {
+        if ((size_t)tag >= _waiting.size())
+            return;
+        for (const rs_operand &w : _waiting[tag]) {
+            rs_entry &rse = _rs[w.index];
+            rs_entry::op_info &s = rse.src[w.operand];
+            if (!rse.busy || s.ready || s.field != tag) continue;
+            s.ready = true;
+            s.field = data;
+            if (rse.all_ops_ready())
+                set(_ready, _slot[w.index]);
         }
-        std::sort(indices.begin(), indices.end(),
-                [&] (size_t i, size_t j) {
-                    return _q_pos[i] != 0 && _q_pos[i] < _q_pos[j];
-                } );
-        return indices;
+        _waiting[tag].clear();
+    }
+    // The oldest entry whose operands are all ready, size() if there is none
+    size_t oldestReady() const {
+        return first(_ready, 0);
+    }
+    // The oldest ready entry younger than entry i, which may have left the station
+    // since, size() if there is none
+    size_t nextReady(size_t i) const {
+        return first(_ready, _slot[i] + 1);
     }
     friend std::ostream& operator<< (std::ostream& out, ReservationStation& rrf);
-} rs;
-unsigned ReservationStation::_last_q_pos = 1;
+};
 
 std::ostream& operator<< (std::ostream& out, ReservationStation& rs) {
     out << std::setfill('=') << std::setw(75) << "" << std::endl;
@@ -320,8 +522,17 @@ struct rob_entry {
     unsigned addr;
     int arf_index;
     int rrf_index;
-    //bool speculative;
-    //bool valid;
+    unsigned long seq = 0;      // dispatch order, younger instructions have larger numbers
+    operation_type op = INVALID;
+    // Branches
+    bool is_branch = false;
+    bool resolved = false;
+    bool predicted_taken = false;
+    bool taken = false;
+    unsigned target = 0;        // program index of the taken path
+    uint64_t history = 0;       // global history when the instruction was fetched
+    int checkpoint = -1;        // rename map checkpoint, -1 to recover by walking the ROB
+    stage_cycles timeline = {}; // cycle in which it reached each stage of the pipeline
 };
 
 class ReOrderBuffer {
@@ -347,7 +558,7 @@ class ReOrderBuffer {
         return _rob.size();
     }
     void setSize(size_t sz) {
-        _rob.resize(sz);
+        _rob.resize(sz, rob_entry());
     }
     int entryCount() {
         return _entry_count;
@@ -366,6 +577,7 @@ class ReOrderBuffer {
     }
     void pop() {
         //if (empty()) throw buffer_underflow_error("ROB empty!");
+        _rob[_head] = rob_entry();
         _rob[_head].busy = false;
         _rob[_head].addr = 0;
         _rob[_head].rrf_index = 0;
@@ -373,11 +585,27 @@ class ReOrderBuffer {
         _head = (_head+1) % size();
         _entry_count--;
     }
+    // Removes the youngest entry
+    void popBack() {
+        _tail = (_tail+size()-1) % size();
+        _rob[_tail] = rob_entry();
+        _rob[_tail].busy = false;
+        _rob[_tail].addr = 0;
+        _rob[_tail].rrf_index = 0;
+        _rob[_tail].arf_index = 0;
+        _entry_count--;
+    }
     rob_entry& front() {
         return _rob[_head];
     }
+    rob_entry& back() {
+        return _rob[(_tail+size()-1) % size()];
+    }
+    int backIndex() {
+        return (_tail+size()-1) % size();
+    }
     friend std::ostream& operator<< (std::ostream&, ReOrderBuffer&);
-} rob;
+};
 
 std::ostream& operator<< (std::ostream& out, ReOrderBuffer& rob) {
     out << std::setfill('=') << std::setw(40) << "" << std::endl;
@@ -409,7 +637,7 @@ struct sb_entry {
     bool busy;
     int data;
     unsigned mem_addr;
-    std::queue<int> rrf_indices_to_update;
+    int timer = -1;     // cycles until the write finishes, -1 before it starts
 };
 
 class StoreBuffer {
@@ -457,13 +685,344 @@ class StoreBuffer {
         _sb[_head].busy = false;
         _sb[_head].mem_addr = 0;
         _sb[_head].data = 0;
+        _sb[_head].timer = -1;
         _head = (_head+1) % size();
         _entry_count--;
     }
     sb_entry& front() {
         return _sb[_head];
     }
-} sb;
+};
+
+// Loads from dispatch to commit, oldest first
+struct lq_entry {
+    unsigned long seq = 0;
+    int rob_index = 0;
+    unsigned pc = 0;                // instruction address
+    bool executed = false;          // has read its value
+    unsigned mem_addr = 0;
+    int value = 0;
+    int latency = 0;                // cycles until the value can be broadcast
+    unsigned long source = 0;       // store in the SQ it was forwarded from, 0 if none
+    unsigned long wait_for = 0;     // store predicted to write its location, 0 if none
+};
+
+// Stores from dispatch to commit, oldest first. A store executes when both its address
+// and its data are known, and moves to the store buffer when it commits.
+struct sq_entry {
+    unsigned long seq = 0;
+    unsigned pc = 0;
+    bool executed = false;
+    unsigned mem_addr = 0;
+    int data = 0;
+};
+
+// Circular queue of the entries of the load or the store queue. Entries are allocated
+// at the tail in program order and leave from the head at commit, or from the tail
+// when squashed.
+template <typename Entry>
+class MemoryQueue {
+    std::vector<Entry> _q;
+    int _head = 0;
+    int _tail = 0;
+    unsigned _entry_count = 0;
+
+    public:
+    Entry& operator[] (size_t i) {
+        return _q[i];
+    }
+    int head() {
+        return _head;
+    }
+    int tail() {
+        return _tail;
+    }
+    int size() {
+        return _q.size();
+    }
+    void setSize(size_t sz) {
+        _q.assign(sz, Entry());
+        _head = _tail = _entry_count = 0;
+    }
+    int entryCount() {
+        return _entry_count;
+    }
+    bool empty() {
+        return _entry_count == 0;
+    }
+    bool full() {
+        return _entry_count == _q.size();
+    }
+    // Index of the n-th oldest entry
+    int at(int n) {
+        return (_head + n) % size();
+    }
+    void push(const Entry &e) {
+        _q[_tail] = e;
+        _tail = (_tail+1) % size();
+        _entry_count++;
+    }
+    void pop() {
+        _q[_head] = Entry();
+        _head = (_head+1) % size();
+        _entry_count--;
+    }
+    void popBack() {
+        _tail = (_tail+size()-1) % size();
+        _q[_tail] = Entry();
+        _entry_count--;
+    }
+    Entry& front() {
+        return _q[_head];
+    }
+    Entry& back() {
+        return _q[(_tail+size()-1) % size()];
+    }
+};
+
+// Data side of the memory system. Without a cache configuration every access takes a
+// cycle. With one, loads and stores go through a cache hierarchy as modelled in
+// Assignment 2 and take the hit latency of the level holding the line. An L1 miss
+// holds an MSHR until its line arrives; later accesses to the line wait for the same
+// fill, and a miss that finds every MSHR taken cannot start.
+class DataCache {
+    struct mshr {
+        unsigned long line;
+        int timer;      // cycles until the line arrives
+    };
+    CacheHierarchy _caches;
+    bool _enabled = false;
+    size_t _mshr_count = 0;
+    std::vector<mshr> _mshrs;
+
+    // Memory holds words, so word i is at byte address 4i. Each hardware thread has its
+    // own memory, told apart by the bits above the 32 of a program's addresses.
+    static unsigned long byteAddress(unsigned long addr) {
+        return (unsigned long)addr * sizeof(unsigned);
+    }
+    unsigned long line(unsigned long addr) {
+        return byteAddress(addr) / _caches.level(0).lineSize();
+    }
+    mshr* pending(unsigned long addr) {
+        for (mshr &m : _mshrs)
+            if (m.line == line(addr))
+                return &m;
+        return NULL;
+    }
+    // Level the line of addr is found in, levelCount() for memory
+    int hitLevel(unsigned long addr) {
+        int set_no, line_no, level = 0;
+        while (level < _caches.levelCount()
+                && !_caches.level(level).probe(byteAddress(addr), set_no, line_no))
+            ++level;
+        return level;
+    }
+    // Latency of an access that found its line at level
+    int latency(unsigned long addr, int level) {
+        if (level == 0)
+            return _caches.latency(0);
+        int lat = _caches.latency(level);
+        _mshrs.push_back(mshr{line(addr), lat});
+        return lat;
+    }
+
+    public:
+    // Builds the hierarchy from an Assignment 2 configuration file. Returns false if it
+    // cannot be read.
+    bool configure(const std::string &cache_config, size_t mshr_count) {
+        _mshrs.clear();
+        _mshr_count = mshr_count;
+        _enabled = _caches.readConfig(cache_config.c_str());
+        return _enabled;
+    }
+    void disable() {
+        _caches.finalize();
+        _mshrs.clear();
+        _enabled = false;
+    }
+    bool enabled() const {
+        return _enabled;
+    }
+    CacheHierarchy& hierarchy() {
+        return _caches;
+    }
+    size_t mshrCount() const {
+        return _mshr_count;
+    }
+    size_t outstandingMisses() const {
+        return _mshrs.size();
+    }
+    // Cycles taken by a load that gets its value from a store
+    int forwardLatency() {
+        return _enabled ? _caches.latency(0) : 1;
+    }
+    // True if an access to addr can start this cycle
+    bool canAccess(unsigned long addr) {
+        int set_no, line_no;
+        return !_enabled || _mshrs.size() < _mshr_count || pending(addr)
+            || _caches.level(0).probe(byteAddress(addr), set_no, line_no);
+    }
+    // Starts a read of addr and returns the cycles it takes
+    int read(unsigned long addr) {
+        if (!_enabled)
+            return 1;
+        if (mshr *m = pending(addr))
+            return std::max(m->timer, _caches.latency(0));
+        return latency(addr, _caches.read(byteAddress(addr)));
+    }
+    // Starts a write of the word at addr and returns the cycles it takes
+    int write(unsigned long addr) {
+        if (!_enabled)
+            return 1;
+        if (mshr *m = pending(addr))
+            return std::max(m->timer, _caches.latency(0));
+        int level = hitLevel(addr);
+        _caches.write(byteAddress(addr), sizeof(unsigned));
+        return latency(addr, level);
+    }
+    // Accesses the hierarchy without timing, to warm it while the functional model runs
+    void warm(unsigned long addr, bool write) {
+        if (!_enabled)
+            return;
+        if (write)
+            _caches.write(byteAddress(addr), sizeof(unsigned));
+        else
+            _caches.read(byteAddress(addr));
+    }
+    // Advances the misses in flight by a cycle and frees the MSHRs whose lines arrived
+    void tick() {
+        for (auto m = _mshrs.begin(); m != _mshrs.end(); )
+            m = (--m->timer <= 0) ? _mshrs.erase(m) : m + 1;
+    }
+    // Cycles until the next line arrives, -1UL if none is awaited
+    unsigned long nextEvent() const {
+        unsigned long next = -1UL;
+        for (const mshr &m : _mshrs)
+            next = std::min(next, (unsigned long)std::max(m.timer, 1));
+        return next;
+    }
+    // Advances the misses in flight by cycles in which no line arrives
+    void skip(unsigned long cycles) {
+        for (mshr &m : _mshrs)
+            m.timer -= cycles;
+    }
+};
+
+// A type of ALU declared in config.txt: how many there are and the operations they execute
+struct unit_type {
+    std::string name;
+    unsigned count;
+    std::vector<operation_type> ops;
+};
+
+// Sizes, widths, latencies and functional unit counts of the machine. Sizes and
+// latencies are read from config.txt; the rest are optional there and default to the
+// original 2-wide machine.
+struct MachineConfig {
+    unsigned rs_size = 16;
+    unsigned rob_size = 16;
+    unsigned sb_size = 16;
+    unsigned lq_size = 16;
+    unsigned sq_size = 16;
+    unsigned rename_registers = RRF_SIZE;
+    // A merged register file keeps committed values in the physical registers too, and
+    // the ARF becomes the register alias table
+    bool merged_registers = false;
+    unsigned physical_registers = 0;    // 0: ARF_SIZE plus the rename registers
+    unsigned dispatch_width = 2;    // instructions fetched and dispatched per cycle
+    unsigned issue_width = 0;       // 0: as many as there are functional units
+    unsigned cdb_count = 1;
+    unsigned commit_width = 1;      // ROB entries retired per cycle
+    unsigned alu_count = 2;         // used when no unit types are declared
+    unsigned load_units = 1;
+    unsigned store_units = 1;
+    std::vector<unit_type> unit_types;
+    // Latency and initiation interval of each ALU operation. Branches compare in one
+    // cycle, and an interval of 0 makes the operation unpipelined.
+    std::array<unsigned, BGE-ADD+1> latency = {{ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 }};
+    std::array<unsigned, BGE-ADD+1> interval = {};
+    std::string predictor = "bimodal";
+    unsigned predictor_bits = 10;   // log2 of the number of entries of each table
+    unsigned btb_entries = 64;
+    unsigned checkpoints = 4;       // rename map checkpoints for branches in flight
+    unsigned walk_width = 4;        // ROB entries undone per cycle without a checkpoint
+    std::string cache_config;       // data caches in the Assignment 2 format, none if empty
+    unsigned mshrs = 8;
+    disambiguation_policy disambiguation = STORE_SETS;
+    unsigned store_set_entries = 1024;
+    // Instructions run by the functional model, without timing, before the detailed
+    // simulation starts. With a detailed interval, the detailed simulation stops after
+    // that many instructions, or alternates with functional intervals to sample the run.
+    unsigned long fast_forward = 0;
+    unsigned long detailed_interval = 0;    // 0: to the end of the program
+    unsigned long functional_interval = 0;
+    bool functional_warming = true;         // train the caches and predictors meanwhile
+    // Jump over cycles in which nothing happens but timers counting down
+    bool skip_idle = true;
+    // With several hardware threads: which one fetches in a cycle, and whether the ROB,
+    // load and store queues and store buffer are split evenly between them or shared
+    thread_fetch_policy fetch_policy = ICOUNT;
+    bool shared_buffers = false;
+
+    unsigned aluCount() const {
+        if (unit_types.empty())
+            return alu_count;
+        unsigned count = 0;
+        for (const unit_type &t : unit_types)
+            count += t.count;
+        return count;
+    }
+    unsigned issueWidth() const {
+        return issue_width ? issue_width : aluCount() + load_units + store_units;
+    }
+    unsigned registerCount(unsigned threads = 1) const {
+        if (!merged_registers)
+            return rename_registers;
+        return physical_registers ? physical_registers : threads*ARF_SIZE + rename_registers;
+    }
+    // Entries of a buffer of the given size each of the threads can hold
+    unsigned threadShare(unsigned size, unsigned threads) const {
+        return shared_buffers ? size : std::max(size / threads, 1u);
+    }
+    unsigned intervalOf(operation_type op) const {
+        return interval[op-ADD] ? interval[op-ADD] : latency[op-ADD];
+    }
+};
+
+// Statistics gathered over a run. They are printed at the end whatever the verbosity.
+struct Statistics {
+    unsigned long committed = 0;
+    std::vector<unsigned long> alu_busy;
+    unsigned long ldu_busy = 0;     // summed over all units of the type
+    unsigned long stu_busy = 0;
+    unsigned long cdb_busy = 0;     // summed over all CDBs
+    unsigned long mem_bus_busy = 0;
+    unsigned long branches = 0;     // committed conditional branches
+    unsigned long mispredictions = 0;
+    unsigned long squashed = 0;     // wrong-path instructions removed from the ROB
+    unsigned long btb_misses = 0;
+    unsigned long forwarded = 0;    // loads that got their value from the SQ or SB
+    unsigned long violations = 0;   // loads replayed after reading a stale value
+    unsigned long fast_forwarded = 0;   // instructions run by the functional model
+    unsigned long functional_intervals = 0;
+    // Instructions committed by each hardware thread, and the cycle it finished in
+    std::vector<unsigned long> thread_committed;
+    std::vector<unsigned long> thread_cycles;
+    // Number of cycles in which each kind of stall occurred
+    std::array<unsigned long, STALL_REASON_COUNT> stalls = {};
+    // Occupancy histograms: element i is the number of cycles with i entries in use
+    std::vector<unsigned long> rs_occupancy;
+    std::vector<unsigned long> rob_occupancy;
+    std::vector<unsigned long> sb_occupancy;
+    std::vector<unsigned long> lq_occupancy;
+    std::vector<unsigned long> sq_occupancy;
+    std::vector<unsigned long> rrf_occupancy;
+    std::vector<unsigned long> mshr_occupancy;
+    // Element i is the number of loads whose cache access took i cycles
+    std::vector<unsigned long> load_latency;
+};
+
+class Core;
 
 class FunctionalUnit {
     protected:
@@ -471,40 +1030,55 @@ class FunctionalUnit {
     int _rs_index = -1; // reservation station entry dispatched to this execution unit
     public:
     bool busy = false;
-    virtual void executeInstn(int) = 0;
-    virtual void updateTimer() = 0;
+    virtual void executeInstn(Core&, int) = 0;
+    virtual void updateTimer(Core&) = 0;
 };
 
+// Pipelined load unit. It executes one load a cycle. The value is read into the load
+// queue when the load issues, from the store queue, the store buffer or memory, and is
+// broadcast once the access has finished. Misses wait in the MSHRs, so a unit can
+// have many loads in flight; those whose result finds no free CDB wait for one without
+// holding up the others.
 class LoadUnit : public FunctionalUnit {
-    const static int _latency = 1;
-    //int _dest_rrf_index = -1;
-    //int _result;
+    struct in_flight {
+        int dest_rrf_index;
+        int result;
+        int timer;
+        unsigned long seq;
+        int thread;
+        int rob_index;
+    };
+    std::vector<in_flight> _in_flight;
 
     public:
-    static int latency() {
-        return _latency;
+    bool waitingForCDB() const {
+        for (const in_flight &f : _in_flight)
+            if (f.timer == 0)
+                return true;
+        return false;
+    }
+    void executeInstn(Core &core, int rs_index);
+    void updateTimer(Core &core);
+    // Cycles until a load finishes, -1UL if none is in flight
+    unsigned long nextEvent() const {
+        unsigned long next = -1UL;
+        for (const in_flight &f : _in_flight)
+            next = std::min(next, (unsigned long)std::max(f.timer, 1));
+        return next;
+    }
+    void skip(unsigned long cycles) {
+        for (in_flight &f : _in_flight)
+            f.timer -= cycles;
+    }
+    // Drops the loads of a thread younger than seq after a misprediction. Their misses
+    // still complete and fill the caches.
+    void squash(int thread, unsigned long seq) {
+        for (auto f = _in_flight.begin(); f != _in_flight.end(); )
+            f = (f->thread == thread && f->seq > seq) ? _in_flight.erase(f) : f + 1;
     }
-    void executeInstn(int rs_index) {
-        _rs_index = rs_index;
-        //_dest_rrf_index = rs[rs_index].dest;
-        //unsigned addr = rs[rs_index].src[0].field;
-        //_result = memory[addr];
-        _timer = latency();
-        busy = true;
-        //rs.pop(rs_index);
-    }
-    void updateTimer() {
-        if (_timer > 0)
-            _timer--;
-        if (_timer == 0 && busy && !cdb.busy) {
-            //cdb.busy = true;
-            //cdb.tag = _dest_rrf_index;
-            //cdb.data = _result;
-            busy = false;
-        }
-    }
-} ldu;
+};
 
+// Stores execute in a cycle, writing their address and data into the store queue
 class StoreUnit : public FunctionalUnit {
     const static int _latency = 1;
 
@@ -512,68 +1086,411 @@ class StoreUnit : public FunctionalUnit {
     static int latency() {
         return _latency;
     }
-    void executeInstn(int rs_index) {
-        _rs_index = rs_index;
-        _timer = latency();
-        busy = true;
-        //rs.pop(rs_index);
-    }
-    void updateTimer() {
+    void executeInstn(Core &core, int rs_index);
+    void updateTimer(Core&) {
         if (_timer > 0)
             _timer--;
         if (_timer == 0 && busy) {
             busy = false;
         }
     }
-} stu;
+    unsigned long nextEvent() const {
+        return busy ? std::max(_timer, 1) : -1UL;
+    }
+    void skip(unsigned long cycles) {
+        if (busy)
+            _timer -= cycles;
+    }
+};
+
+// Conditional branches that finished executing in the current cycle
+struct branch_result {
+    unsigned long seq;
+    int thread;
+    int rob_index;
+    bool taken;
+};
 
+// Pipelined integer unit. Each operation has a latency and an initiation interval, the
+// number of cycles before the unit accepts another operation; an interval equal to the
+// latency makes the operation unpipelined. Several operations can be in flight, and
+// finished ones take a CDB oldest first. A result that finds no free CDB stalls the
+// whole unit until it gets one.
 class IntegerALU : public FunctionalUnit {
-    static std::array<int, XOR-ADD+1> _latency; //Latency of each operation
-    int _dest_rrf_index = -1;
-    int _result;
+    std::array<int, BGE-ADD+1> _latency; //Latency of each operation
+    std::array<int, BGE-ADD+1> _interval; //Initiation interval of each operation
+    struct in_flight {
+        int dest_rrf_index;
+        int result;
+        int timer;
+        unsigned long seq;
+        int thread;
+        int rob_index;
+        bool branch;
+    };
+    std::deque<in_flight> _in_flight; // oldest first
+    std::string _type = "ALU";
+    std::array<bool, BGE-ADD+1> _executes; // operations this unit can execute
+
+    void setTimings(const MachineConfig &config) {
+        for (int op = ADD; op <= BGE; ++op) {
+            _latency[op-ADD] = config.latency[op-ADD];
+            _interval[op-ADD] = config.intervalOf((operation_type)op);
+        }
+    }
 
     public:
-    static int latency(operation_type op) {
+    IntegerALU(const MachineConfig &config) {
+        setTimings(config);
+        _executes.fill(true);
+    }
+    // A unit that can subtract also compares, so it executes the conditional branches
+    IntegerALU(const MachineConfig &config, const unit_type &t) : _type(t.name) {
+        setTimings(config);
+        _executes.fill(false);
+        for (operation_type op : t.ops) {
+            _executes[op-ADD] = true;
+            if (op == SUB)
+                for (int br = BEQ; br <= BGE; ++br)
+                    _executes[br-ADD] = true;
+        }
+    }
+    int latency(operation_type op) const {
         return _latency[op-ADD];
     }
-    static void setLatency(operation_type op, int lat) {
-        _latency[op-ADD] = lat;
+    int interval(operation_type op) const {
+        return _interval[op-ADD];
     }
-    int computeResult(int op1, int op2, operation_type op) {
+    const std::string& type() const {
+        return _type;
+    }
+    bool executes(operation_type op) const {
+        return _executes[op-ADD];
+    }
+    // True if the result is ready but every CDB was taken by another unit this cycle
+    bool waitingForCDB() const {
+        return !_in_flight.empty() && _in_flight.front().timer == 0;
+    }
+    bool canAccept(operation_type op) const {
+        return executes(op) && _timer == 0 && !waitingForCDB();
+    }
+    // Division by zero, which a wrong-path DIV can reach, and the overflowing
+    // INT_MIN / -1 give 0 rather than trapping
+    static int computeResult(int op1, int op2, operation_type op) {
         switch(op) {
             case ADD: return op1 + op2;
             case SUB: return op1 - op2;
             case MUL: return op1 * op2;
-            case DIV: return op1 / op2;
+            case DIV: return (op2 == 0 || (op1 == INT_MIN && op2 == -1)) ? 0 : op1 / op2;
             case AND: return op1 & op2;
             case OR:  return op1 | op2;
             case XOR: return op1 ^ op2;
+            case BEQ: return op1 == op2;
+            case BNE: return op1 != op2;
+            case BLT: return op1 < op2;
+            case BGE: return op1 >= op2;
             default:  throw std::invalid_argument("Invalid ALU operation");
         }
     }
-    void executeInstn(int rs_index) {
-        int op1, op2;
-        operation_type op;
-        _rs_index = rs_index;
-        op1 = rs[rs_index].src[0].field;
-        op2 = rs[rs_index].src[1].field;
-        op = rs[rs_index].op_type;
-        _result = computeResult(op1, op2, op);
-        _dest_rrf_index = rs[rs_index].dest;
-        _timer = latency(op);
-        busy = true;
-        rs.pop(rs_index);
-    }
-    void updateTimer() {
+    void executeInstn(Core &core, int rs_index);
+    void updateTimer(Core &core);
+    // Cycles until the unit accepts an operation again or one finishes, -1UL if
+    // neither is awaited
+    unsigned long nextEvent() const {
+        unsigned long next = _timer > 0 ? _timer : -1UL;
+        if (!_in_flight.empty())
+            next = std::min(next, (unsigned long)std::max(_in_flight.front().timer, 1));
+        return next;
+    }
+    void skip(unsigned long cycles) {
         if (_timer > 0)
-            _timer--;
-        if (_timer == 0 && busy && !cdb.busy) {
-            cdb.busy = true;
-            cdb.tag = _dest_rrf_index;
-            cdb.data = _result;
-            busy = false;
-        }
+            _timer -= cycles;
+        for (in_flight &f : _in_flight)
+            f.timer -= cycles;
+    }
+    // Drops the operations of a thread younger than seq after a misprediction
+    void squash(int thread, unsigned long seq) {
+        for (auto f = _in_flight.begin(); f != _in_flight.end(); )
+            f = (f->thread == thread && f->seq > seq) ? _in_flight.erase(f) : f + 1;
+        busy = !_in_flight.empty();
     }
 };
-std::array<int, XOR-ADD+1> IntegerALU::_latency; //Latency of each operation
-std::array<IntegerALU, ALU_COUNT> alus;
+
+// First unit of the given type that is not busy, or NULL if there is none
+template <typename Unit>
+Unit* freeUnit(std::vector<Unit> &units) {
+    for (Unit &u : units)
+        if (!u.busy)
+            return &u;
+    return NULL;
+}
+
+// Copies of the rename map (the busy bits and tags of the ARF) taken when conditional
+// branches are dispatched, so that a misprediction can restore the map at once
+struct rename_map {
+    bool used = false;
+    std::array<bool, ARF_SIZE> busy;
+    std::array<int, ARF_SIZE> tag;
+};
+
+#define MAX_THREADS 4
+
+// One hardware thread: its program and front end, its registers, rename map and
+// memory, and the buffers that keep its instructions in program order. The threads of
+// a core share the reservation station, the rename registers, the functional units,
+// the CDBs, the caches and the branch predictors.
+struct HardwareThread {
+    int id = 0;
+    const ProgramImage *program = NULL;
+    ArchitectedRegisterFile arf;
+    DataMemory memory;
+    ReOrderBuffer rob;
+    StoreBuffer sb;
+    MemoryQueue<lq_entry> lq;
+    MemoryQueue<sq_entry> sq;
+
+    // Front end: the program index of the next instruction to fetch, the speculative
+    // global branch history and the cycles for which dispatch is held up
+    unsigned fetch_pc = 0;
+    FetchBuffer fetch_buffer;
+    uint64_t global_history = 0;
+    unsigned recovery_cycles = 0;
+    bool btb_bubble = false;
+    std::vector<rename_map> checkpoints;
+    // With a merged register file, the physical register holding the committed value of
+    // each architectural register
+    std::array<int, ARF_SIZE> retirement_map;
+    // The last instruction committed, the program index of the one following it on the
+    // correct path and the branch history after it
+    unsigned long committed_seq = 0;
+    unsigned committed_pc = 0;
+    uint64_t committed_history = 0;
+
+    bool finished() {
+        return rob.empty() && sb.empty() && fetch_pc >= program->size();
+    }
+};
+
+// The programs run by the hardware threads of a core, one each
+typedef std::vector<const ProgramImage*> Workload;
+
+// One simulated processor running one program on each of its hardware threads. Every
+// structure of the machine belongs to it, so several cores with different
+// configurations can run side by side, each on its own thread. The programs are
+// shared and only read.
+class Core {
+    public:
+    const MachineConfig config;
+    Statistics stats;
+
+    bus mem_bus;
+    // Common data buses. A result needs one of them to be broadcast.
+    std::vector<bus> cdbs;
+    std::vector<HardwareThread> threads;
+    RenameRegisterFile rrf;
+    ReservationStation rs;
+    DataCache dcache;
+    std::vector<branch_result> branch_results;
+    // Functional units of each type, sized from the configuration
+    std::vector<IntegerALU> alus;
+    std::vector<LoadUnit> ldus;
+    std::vector<StoreUnit> stus;
+
+    unsigned long next_seq = 1;     // shared by the threads, so it tells instructions apart
+    std::unique_ptr<BranchPredictor> predictor;
+    BranchTargetBuffer btb;
+    StoreSetPredictor store_sets;
+    // Counts the changes of state other than timers counting down, so that a cycle in
+    // which it does not move is known to be idle
+    unsigned long progress = 0;
+    // The cycle being simulated, and where the timeline of each instruction leaving the
+    // ROB is written, NULL for nowhere
+    unsigned long cycle = 0;
+    TimelineWriter *timeline_writer = NULL;
+
+    // Puts every structure in its initial state for the configuration, with a hardware
+    // thread for each program
+    Core(const MachineConfig &config, const Workload &programs);
+
+    // A CDB not yet taken this cycle, or NULL if they are all busy
+    bus* freeCDB() {
+        for (bus &b : cdbs)
+            if (!b.busy)
+                return &b;
+        return NULL;
+    }
+    // Notes that the instruction in ROB entry i of a thread reached a stage this cycle
+    void stamp(int thread, int i, pipeline_stage stage) {
+        threads[thread].rob[i].timeline[stage] = cycle;
+    }
+    // Address in the caches of word addr of a thread's memory
+    static unsigned long cacheAddress(const HardwareThread &t, unsigned addr) {
+        return (unsigned long)t.id << 32 | addr;
+    }
+    // First ALU that can start the operation this cycle, or NULL if there is none
+    IntegerALU* freeALU(operation_type op) {
+        for (IntegerALU &alu : alus)
+            if (alu.canAccept(op))
+                return &alu;
+        return NULL;
+    }
+    // Whether thread t has no room left in one of its buffers. Shared buffers are also
+    // full once the threads together hold size entries.
+    template <typename Buffer>
+    bool full(HardwareThread &t, Buffer HardwareThread::*buffer, unsigned size) {
+        if ((t.*buffer).full())
+            return true;
+        if (!config.shared_buffers || threads.size() == 1)
+            return false;
+        unsigned used = 0;
+        for (HardwareThread &u : threads)
+            used += (u.*buffer).entryCount();
+        return used >= size;
+    }
+    template <typename Buffer>
+    unsigned entryCount(Buffer HardwareThread::*buffer) {
+        unsigned used = 0;
+        for (HardwareThread &t : threads)
+            used += (t.*buffer).entryCount();
+        return used;
+    }
+
+    unsigned long simulate(unsigned long first_dump, unsigned long last_dump);
+    unsigned long fastForward(HardwareThread &t, unsigned long count);
+    void printCycle(unsigned long cycle);
+    void printSummary(unsigned long cycles);
+
+    private:
+    void initialiseMemoryAndARF(HardwareThread &t);
+    void allocateResStnEntry(HardwareThread &t, const instruction& instn, int dest_rrf_index);
+    void allocateROBEntry(HardwareThread &t, const instruction& instn, int dest_rrf_index);
+    int saveCheckpoint(HardwareThread &t);
+    void freeCheckpoint(HardwareThread &t, int c);
+    stall_reason dispatchInstn(HardwareThread &t, const instruction& instn);
+    stall_reason dispatchStoreInstn(HardwareThread &t, const instruction &instn);
+    stall_reason dispatchBranchInstn(HardwareThread &t, const instruction &instn);
+    stall_reason dispatch(HardwareThread &t, const instruction &instn);
+    bool fetchAndDispatch(HardwareThread &t);
+    void fetchStage(bool draining);
+    unsigned long squashYoungerThan(HardwareThread &t, unsigned long seq);
+    void walkRenameMap(HardwareThread &t, unsigned long squashed);
+    void squashAfter(HardwareThread &t, int b);
+    void replayLoad(HardwareThread &t, const lq_entry &ld);
+    void resolveBranches();
+    void forwardOperand(int tag, int data);
+    stall_reason readLoadValue(const rs_entry &rse);
+    void checkMemoryOrder(HardwareThread &t, const sq_entry &st);
+    void execute();
+    bool commitHead(HardwareThread &t);
+    void recordCommit(HardwareThread &t, const rob_entry &head);
+    void traceInstruction(HardwareThread &t, const rob_entry &e, bool squashed);
+    void flushPipeline(HardwareThread &t);
+    int registerValue(HardwareThread &t, int r);
+    void setRegisterValue(HardwareThread &t, int r, int value);
+    void complete();
+    bool retire(HardwareThread &t, bool bus_taken);
+    void sampleCycle(unsigned long cycles = 1);
+    unsigned long cyclesToNextEvent();
+    void skipIdleCycles(unsigned long cycles,
+            const std::array<unsigned long, STALL_REASON_COUNT> &stalls_before);
+    void printMemorySummary(unsigned long cycles);
+};
+void LoadUnit::executeInstn(Core &core, int rs_index) {
+    _rs_index = rs_index;
+    const rs_entry &rse = core.rs[rs_index];
+    const lq_entry &lqe = core.threads[rse.thread].lq[rse.lsq_index];
+    _in_flight.push_back(in_flight{rse.dest, lqe.value, lqe.latency, rse.seq, rse.thread, rse.rob_index});
+    busy = true;
+    core.rs.pop(rs_index);
+}
+
+void LoadUnit::updateTimer(Core &core) {
+    busy = false;
+    for (auto f = _in_flight.begin(); f != _in_flight.end(); ) {
+        if (f->timer > 0 && --f->timer == 0)
+            core.stamp(f->thread, f->rob_index, COMPLETE);
+        bus *cdb = (f->timer == 0) ? core.freeCDB() : NULL;
+        if (!cdb) {
+            ++f;
+            continue;
+        }
+        cdb->busy = true;
+        cdb->tag = f->dest_rrf_index;
+        cdb->data = f->result;
+        cdb->seq = f->seq;
+        cdb->thread = f->thread;
+        core.stamp(f->thread, f->rob_index, WRITEBACK);
+        f = _in_flight.erase(f);
+    }
+}
+
+void StoreUnit::executeInstn(Core &core, int rs_index) {
+    _rs_index = rs_index;
+    const rs_entry &rse = core.rs[rs_index];
+    sq_entry &sqe = core.threads[rse.thread].sq[rse.lsq_index];
+    sqe.mem_addr = rse.src[0].field;
+    sqe.data = rse.src[1].field;
+    sqe.executed = true;
+    // Its work is done once the store queue has the address and data
+    core.stamp(rse.thread, rse.rob_index, COMPLETE);
+    core.stamp(rse.thread, rse.rob_index, WRITEBACK);
+    _timer = latency();
+    busy = true;
+    core.rs.pop(rs_index);
+}
+
+void IntegerALU::executeInstn(Core &core, int rs_index) {
+    int op1, op2;
+    operation_type op;
+    _rs_index = rs_index;
+    const rs_entry &rse = core.rs[rs_index];
+    op1 = rse.src[0].field;
+    op2 = rse.src[1].field;
+    op = rse.op_type;
+    in_flight f;
+    f.result = computeResult(op1, op2, op);
+    f.dest_rrf_index = rse.dest;
+    f.timer = latency(op);
+    f.seq = rse.seq;
+    f.thread = rse.thread;
+    f.rob_index = rse.rob_index;
+    f.branch = op >= BEQ && op <= BGE;
+    // Operations of different latencies can finish out of order
+    auto pos = _in_flight.end();
+    while (pos != _in_flight.begin() && (pos-1)->timer > f.timer)
+        --pos;
+    _in_flight.insert(pos, f);
+    _timer = interval(op);
+    busy = true;
+    core.rs.pop(rs_index);
+}
+
+void IntegerALU::updateTimer(Core &core) {
+    if (!waitingForCDB()) {
+        if (_timer > 0)
+            _timer--;
+        for (in_flight &f : _in_flight)
+            if (--f.timer == 0)
+                core.stamp(f.thread, f.rob_index, COMPLETE);
+    }
+    while (waitingForCDB()) {
+        in_flight &f = _in_flight.front();
+        // A branch outcome goes to the ROB and needs no CDB
+        if (f.branch) {
+            core.branch_results.push_back(branch_result{f.seq, f.thread, f.rob_index, f.result != 0});
+            core.stamp(f.thread, f.rob_index, WRITEBACK);
+            _in_flight.pop_front();
+            continue;
+        }
+        bus *cdb = core.freeCDB();
+        if (!cdb) break;
+        cdb->busy = true;
+        cdb->tag = f.dest_rrf_index;
+        cdb->data = f.result;
+        cdb->seq = f.seq;
+        cdb->thread = f.thread;
+        core.stamp(f.thread, f.rob_index, WRITEBACK);
+        _in_flight.pop_front();
+    }
+    busy = !_in_flight.empty();
+}
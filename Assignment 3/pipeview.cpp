@@ -0,0 +1,159 @@
+/*
+ *  Converts a timeline trace written by outoforder -t into the O3PipeView text format
+ *  of gem5, which Konata and gem5's o3-pipeview.py display. Given the programs the
+ *  trace was made from, one for each hardware thread, instructions are shown with
+ *  their operands.
+ *  USAGE:- ./pipeview [-l] [-c TICKS] trace_file [instruction_file ...]
+ */
+
+#include <iomanip>
+#include <memory>
+#include "program.hpp"
+#include "timeline.hpp"
+
+// Reads the records of a trace a buffer at a time
+class TimelineReader {
+    static const size_t BUFFER_RECORDS = 4096;
+    FILE *_file = NULL;
+    std::vector<timeline_record> _buffer;
+    size_t _next = 0;
+
+    public:
+    ~TimelineReader() {
+        if (_file)
+            fclose(_file);
+    }
+    // Returns false if the file cannot be read or is not a timeline trace
+    bool open(const std::string &filename) {
+        _file = fopen(filename.c_str(), "rb");
+        if (!_file)
+            return false;
+        timeline_header header;
+        return fread(&header, sizeof(header), 1, _file) == 1
+            && memcmp(header.magic, TIMELINE_MAGIC, sizeof(header.magic)) == 0
+            && header.version == TIMELINE_VERSION
+            && header.record_size == sizeof(timeline_record);
+    }
+    bool next(timeline_record &r) {
+        if (_next == _buffer.size()) {
+            _buffer.resize(BUFFER_RECORDS);
+            _buffer.resize(fread(_buffer.data(), sizeof(timeline_record), BUFFER_RECORDS, _file));
+            _next = 0;
+            if (_buffer.empty())
+                return false;
+        }
+        r = _buffer[_next++];
+        return true;
+    }
+};
+
+// Cycle of a stage after fetch, 0 if the instruction did not reach it
+unsigned long stageCycle(const timeline_record &r, pipeline_stage stage) {
+    if (stage == FETCH)
+        return r.fetch;
+    uint32_t after = r.after_fetch[stage-1];
+    return (after == NO_CYCLE) ? 0 : r.fetch + after;
+}
+
+// The instruction with its operands if the program of its thread was given, and
+// with the thread if it is not the first
+std::string instructionText(const timeline_record &r,
+        const std::vector<std::unique_ptr<ProgramImage>> &programs) {
+    std::ostringstream out;
+    if (r.thread > 0)
+        out << "T" << r.thread << ": ";
+    if (r.thread < programs.size() && r.pc >= 1 && r.pc <= programs[r.thread]->size())
+        out << disassemble(programs[r.thread]->decode(r.pc - 1));
+    else
+        out << (operation_type)r.op;
+    return out.str();
+}
+
+// gem5 has no writeback stage: its complete is when execution finishes, and the wait
+// for a CDB shows as part of the time before commit. Decode and rename happen when
+// the instruction is dispatched. A squashed instruction retires at tick 0.
+void printO3PipeView(const timeline_record &r, const std::string &text, unsigned long ticks) {
+    auto tick = [&] (pipeline_stage stage) { return stageCycle(r, stage) * ticks; };
+    std::cout << "O3PipeView:fetch:" << tick(FETCH) << ":0x" << std::hex << std::setfill('0')
+        << std::setw(8) << r.pc << std::dec << std::setfill(' ') << ":0:" << r.seq << ":" << text << "\n"
+        << "O3PipeView:decode:" << tick(DISPATCH) << "\n"
+        << "O3PipeView:rename:" << tick(DISPATCH) << "\n"
+        << "O3PipeView:dispatch:" << tick(DISPATCH) << "\n"
+        << "O3PipeView:issue:" << tick(ISSUE) << "\n"
+        << "O3PipeView:complete:" << tick(COMPLETE) << "\n"
+        << "O3PipeView:retire:" << (r.squashed ? 0 : tick(RETIRE)) << ":store:0\n";
+}
+
+// One line per instruction with the cycle of every stage, '-' for those not reached
+void printRow(const timeline_record &r, const std::string &text) {
+    std::cout << std::setw(10) << r.seq << std::setw(8) << r.pc << "  "
+        << std::left << std::setw(20) << text << std::right;
+    for (int s = FETCH; s < PIPELINE_STAGES; ++s) {
+        unsigned long c = stageCycle(r, (pipeline_stage)s);
+        if (c)
+            std::cout << std::setw(10) << c;
+        else
+            std::cout << std::setw(10) << "-";
+    }
+    std::cout << (r.squashed ? "  squashed" : "") << "\n";
+}
+
+void usage(const char *prog) {
+    std::cerr << "USAGE:- " << prog << " [-l] [-c TICKS] trace_file [instruction_file ...]" << std::endl
+        << "  -l          print a table of the cycle of each stage instead" << std::endl
+        << "  -c TICKS    ticks per cycle in the O3PipeView output (default: 1000)" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    bool table = false;
+    unsigned long ticks = 1000;
+    int opt;
+    while ((opt = getopt(argc, argv, "lc:")) != -1) {
+        switch (opt) {
+            case 'l':
+                table = true;
+                break;
+            case 'c':
+                if (sscanf(optarg, "%lu", &ticks) != 1 || ticks == 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string trace_filename = argv[optind++];
+    std::vector<std::unique_ptr<ProgramImage>> programs;
+    while (optind < argc) {
+        programs.emplace_back(new ProgramImage);
+        programs.back()->load(argv[optind++]);
+    }
+
+    TimelineReader trace;
+    if (!trace.open(trace_filename)) {
+        std::cerr << trace_filename << ": not a timeline trace." << std::endl;
+        return 1;
+    }
+    if (table) {
+        std::cout << std::setw(10) << "Seq" << std::setw(8) << "Instn" << "  "
+            << std::left << std::setw(20) << "" << std::right
+            << std::setw(10) << "Fetch" << std::setw(10) << "Dispatch"
+            << std::setw(10) << "Issue" << std::setw(10) << "Complete"
+            << std::setw(10) << "Writeback" << std::setw(10) << "Retire" << "\n";
+    }
+    timeline_record r;
+    while (trace.next(r)) {
+        std::string text = instructionText(r, programs);
+        if (table)
+            printRow(r, text);
+        else
+            printO3PipeView(r, text, ticks);
+    }
+    return 0;
+}
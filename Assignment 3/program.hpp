@@ -0,0 +1,428 @@
+#include <vector>
+#include <array>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The instruction set, the programs read by the simulator and the buffer fetch
+// reads them through. Programs come either as text or in a binary format made by the
+// assembler, with a fixed-width record per instruction.
+
+#define ARF_SIZE 8
+#define MAX_ARITY 2
+
+enum operation_type {
+    INVALID = -1,
+    ADD, SUB, MUL, DIV, AND, OR, XOR,
+    BEQ, BNE, BLT, BGE, JMP,
+    LD, ST
+};
+
+std::ostream& operator<< (std::ostream& out, operation_type op) {
+    switch (op) {
+        case ADD: out << "ADD"; break;
+        case SUB: out << "SUB"; break;
+        case MUL: out << "MUL"; break;
+        case DIV: out << "DIV"; break;
+        case AND: out << "AND"; break;
+        case OR:  out << "OR"; break;
+        case XOR: out << "XOR"; break;
+        case BEQ: out << "BEQ"; break;
+        case BNE: out << "BNE"; break;
+        case BLT: out << "BLT"; break;
+        case BGE: out << "BGE"; break;
+        case JMP: out << "JMP"; break;
+        case LD:  out << "LD"; break;
+        case ST:  out << "ST"; break;
+        default:  out << "INVALID";
+    }
+    return out;
+}
+
+int arity[] = {
+    2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 0,
+    1, 2
+};
+
+std::string toupper(std::string& str) {
+    for (size_t i=0; i < str.size(); ++i) {
+        str[i] = std::toupper(str[i]);
+    }
+    return str;
+}
+
+operation_type decode_instn(std::string instn) {
+    instn = toupper(instn);
+    if (instn == "ADD")      return ADD;
+    else if (instn == "SUB") return SUB;
+    else if (instn == "MUL") return MUL;
+    else if (instn == "DIV") return DIV;
+    else if (instn == "AND") return AND;
+    else if (instn == "OR")  return OR;
+    else if (instn == "XOR") return XOR;
+    else if (instn == "BEQ") return BEQ;
+    else if (instn == "BNE") return BNE;
+    else if (instn == "BLT") return BLT;
+    else if (instn == "BGE") return BGE;
+    else if (instn == "JMP") return JMP;
+    else if (instn == "LD")  return LD;
+    else if (instn == "ST")  return ST;
+    else                     return INVALID; 
+}
+
+bool isALUOperation(operation_type op) {
+    return op >= ADD && op <= XOR;
+}
+
+bool isBranch(operation_type op) {
+    return op >= BEQ && op <= JMP;
+}
+
+bool isConditionalBranch(operation_type op) {
+    return op >= BEQ && op <= BGE;
+}
+
+// Operations that go through an ALU
+bool executesOnALU(operation_type op) {
+    return isALUOperation(op) || isConditionalBranch(op);
+}
+
+bool isLoad(operation_type op) {
+    return op == LD;
+}
+
+bool isStore(operation_type op) {
+    return op == ST;
+}
+
+struct instruction {
+    struct operand {
+        bool is_imm;
+        int field;
+    };
+    unsigned addr;
+    operation_type op;
+    std::array<operand, MAX_ARITY> src;
+    int dest_arf_index;
+    unsigned target = 0;    // program index of a branch target
+};
+
+// Whether the registers an instruction names are R1 to R8. Stores and branches have no
+// destination, and every other operation has one.
+bool registersValid(const instruction &instn) {
+    bool has_dest = instn.op != ST && !isBranch(instn.op);
+    bool valid = has_dest ? instn.dest_arf_index >= 0 && instn.dest_arf_index < ARF_SIZE
+                          : instn.dest_arf_index == -1;
+    for (int j = 0; j < arity[instn.op]; ++j)
+        valid = valid && (instn.src[j].is_imm
+                || (instn.src[j].field >= 0 && instn.src[j].field < ARF_SIZE));
+    return valid;
+}
+
+void fetchDecodeInstructions(std::string instruction_filename, std::vector<instruction> &program) {
+
+    std::ifstream fin(instruction_filename);
+    std::string line;
+    int i = 1;
+    int line_number = 0;
+    // A label is a word ending in ':' before an instruction or on its own line, and
+    // stands for the program index of the next instruction
+    std::map<std::string, unsigned> labels;
+    std::vector<std::string> targets;
+    while (std::getline(fin, line)) {
+        line_number++;
+
+        if (line.empty()) continue;
+
+        instruction instn;
+        std::istringstream iss(line);
+        std::string op, src[MAX_ARITY], dest;
+
+        if (!(iss >> op)) continue;
+        if (op.back() == ':') {
+            labels[op.substr(0, op.size()-1)] = program.size();
+            if (!(iss >> op)) continue;
+        }
+        instn.op = decode_instn(op);
+        if (instn.op == INVALID) {
+            std::cerr << "Instruction " << i << ": operation invalid." << std::endl;
+            std::exit(1);
+        }
+
+        if (instn.op == ST || isBranch(instn.op)) {
+            instn.dest_arf_index = -1;
+        } else {
+            iss >> dest;
+            try {
+                if (dest[0] == 'R' || dest[0] == 'r') {
+                    instn.dest_arf_index = std::stoi(dest.substr(1))-1;
+                } else {
+                    instn.dest_arf_index = std::stoi(dest.substr(1));
+                }
+            } catch (const std::invalid_argument &e) {
+                std::cerr << "Instruction " << i << ": destination operand invalid." << std::endl;
+                std::exit(1);
+            }
+        }
+ 
+        try {
+            for (int j = 0; j < arity[instn.op]; ++j)
+            {
+                iss >> src[j];
+                if (src[j][0] == 'R' || src[j][0] == 'r') {
+                    instn.src[j].field = std::stoi(src[j].substr(1))-1;
+                    instn.src[j].is_imm = false;
+                } else {
+                    instn.src[j].field = std::stoi(src[j]);
+                    instn.src[j].is_imm = true;
+                }
+            }
+        } catch (const std::invalid_argument &e) {
+            std::cerr << "Instruction " << i << ": source operand invalid." << std::endl;
+            std::exit(1);
+        }
+
+        std::string target;
+        if (isBranch(instn.op) && !(iss >> target)) {
+            std::cerr << "Instruction " << i << ": branch target missing." << std::endl;
+            std::exit(1);
+        }
+        targets.push_back(target);
+
+        if (!registersValid(instn)) {
+            std::cerr << "Instruction " << i << " (line " << line_number
+                << "): register out of range." << std::endl;
+            std::exit(1);
+        }
+        instn.addr = i++;
+        program.push_back(instn);
+    }
+
+    for (size_t j = 0; j < program.size(); ++j) {
+        if (!isBranch(program[j].op)) continue;
+        auto label = labels.find(targets[j]);
+        if (label == labels.end()) {
+            std::cerr << "Instruction " << j+1 << ": unknown label " << targets[j] << "." << std::endl;
+            std::exit(1);
+        }
+        program[j].target = label->second;
+    }
+
+    //for (size_t i = 0; i < instn_buffer.size(); ++i) {
+        //instruction &in = instn_buffer[i];
+        //std::cout << in.op << "\t";
+        //for (int j = 0; j < arity[in.op]; ++j) {
+            //std::cout << in.src[j].is_imm << " " << in.src[j].field << ", ";
+        //}
+        //std::cout << in.dest.is_imm << " " << in.dest_arf_index << std::endl;
+    //}
+}
+
+// Text of an instruction in the input format, except that a branch target is shown as
+// the program index it stands for, since the labels are not kept
+std::string disassemble(const instruction &instn) {
+    std::ostringstream out;
+    out << instn.op;
+    if (instn.op != ST && !isBranch(instn.op))
+        out << " R" << instn.dest_arf_index + 1;
+    for (int j = 0; j < arity[instn.op]; ++j) {
+        if (instn.src[j].is_imm)
+            out << " " << instn.src[j].field;
+        else
+            out << " R" << instn.src[j].field + 1;
+    }
+    if (isBranch(instn.op))
+        out << " @" << instn.target;
+    return out.str();
+}
+
+
+// Binary programs start with this header, followed by count records. Fields are in
+// the byte order of the machine that assembled the program.
+struct program_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;         // number of instructions
+    uint32_t reserved;
+};
+
+static const char PROGRAM_MAGIC[4] = { 'O', 'O', 'O', 'B' };
+static const uint32_t PROGRAM_VERSION = 1;
+
+// An instruction in 16 bytes. Bit j of imm is set if source j is an immediate, and a
+// register operand holds the register number counting from 0. dest is -1 if there is
+// no destination register.
+struct encoded_instruction {
+    uint8_t op;
+    int8_t dest;
+    uint8_t imm;
+    uint8_t reserved;
+    int32_t src[MAX_ARITY];
+    uint32_t target;        // program index of a branch target
+};
+static_assert(sizeof(encoded_instruction) == 16, "instructions are 16 bytes");
+
+encoded_instruction encode(const instruction &instn) {
+    encoded_instruction e = {};
+    e.op = instn.op;
+    e.dest = instn.dest_arf_index;
+    for (int j = 0; j < arity[instn.op]; ++j) {
+        e.imm |= instn.src[j].is_imm << j;
+        e.src[j] = instn.src[j].field;
+    }
+    e.target = instn.target;
+    return e;
+}
+
+// Writes the program in the binary format. Returns false if it cannot be written.
+bool writeProgram(const std::string &filename, const std::vector<instruction> &program) {
+    for (size_t i = 0; i < program.size(); ++i) {
+        if (!registersValid(program[i])) {
+            std::cerr << "Instruction " << i+1 << ": register out of range." << std::endl;
+            std::exit(1);
+        }
+    }
+    std::ofstream fout(filename, std::ios::binary);
+    program_header header = {};
+    memcpy(header.magic, PROGRAM_MAGIC, sizeof(header.magic));
+    header.version = PROGRAM_VERSION;
+    header.count = program.size();
+    fout.write((const char*)&header, sizeof(header));
+    for (const instruction &instn : program) {
+        encoded_instruction e = encode(instn);
+        fout.write((const char*)&e, sizeof(e));
+    }
+    return (bool)fout;
+}
+
+// The program being simulated. A binary program is mapped into memory rather than
+// read, and its records are decoded only when fetched; a text program is parsed and
+// encoded when it is loaded. The image is only read while simulating, so every core
+// of a sweep can share it.
+class ProgramImage {
+    std::vector<encoded_instruction> _encoded;  // a text program
+    const encoded_instruction *_records = NULL;
+    size_t _count = 0;
+    void *_map = MAP_FAILED;
+    size_t _map_size = 0;
+
+    ProgramImage(const ProgramImage&);
+    ProgramImage& operator= (const ProgramImage&);
+
+    public:
+    ProgramImage() {}
+    ~ProgramImage() {
+        if (_map != MAP_FAILED)
+            munmap(_map, _map_size);
+    }
+    // Loads a program in either format
+    void load(const std::string &filename) {
+        if (!map(filename)) {
+            std::vector<instruction> program;
+            fetchDecodeInstructions(filename, program);
+            assign(program);
+        }
+    }
+    void assign(const std::vector<instruction> &program) {
+        _encoded.clear();
+        for (const instruction &instn : program) {
+            if (!registersValid(instn)) {
+                std::cerr << "Instruction " << _encoded.size()+1 << ": register out of range." << std::endl;
+                std::exit(1);
+            }
+            _encoded.push_back(encode(instn));
+        }
+        _records = _encoded.data();
+        _count = _encoded.size();
+    }
+    // Maps a binary program. Returns false if the file is not one.
+    bool map(const std::string &filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        program_header header;
+        if (fstat(fd, &st) != 0 || read(fd, &header, sizeof(header)) != sizeof(header)
+                || memcmp(header.magic, PROGRAM_MAGIC, sizeof(header.magic)) != 0) {
+            close(fd);
+            return false;
+        }
+        if (header.version != PROGRAM_VERSION
+                || (size_t)st.st_size < sizeof(header) + (size_t)header.count * sizeof(encoded_instruction)) {
+            std::cerr << filename << ": truncated or unknown binary program." << std::endl;
+            std::exit(1);
+        }
+        _map_size = st.st_size;
+        _map = mmap(NULL, _map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (_map == MAP_FAILED) {
+            std::cerr << filename << ": cannot map the program." << std::endl;
+            std::exit(1);
+        }
+        madvise(_map, _map_size, MADV_SEQUENTIAL);
+        _records = (const encoded_instruction*)((const char*)_map + sizeof(header));
+        _count = header.count;
+        return true;
+    }
+    size_t size() const {
+        return _count;
+    }
+    // The instruction at program index i, checked since a binary program may be corrupt
+    instruction decode(size_t i) const {
+        const encoded_instruction &e = _records[i];
+        instruction instn;
+        instn.addr = i + 1;
+        instn.op = (operation_type)e.op;
+        instn.dest_arf_index = e.dest;
+        for (int j = 0; j < MAX_ARITY; ++j) {
+            instn.src[j].is_imm = (e.imm >> j) & 1;
+            instn.src[j].field = e.src[j];
+        }
+        instn.target = e.target;
+        bool valid = e.op <= ST && registersValid(instn)
+            && (!isBranch(instn.op) || e.target <= _count);
+        if (!valid) {
+            std::cerr << "Instruction " << i+1 << ": invalid encoding." << std::endl;
+            std::exit(1);
+        }
+        return instn;
+    }
+};
+
+// Instructions decoded ahead of fetch. A fetch outside the buffer, after a taken
+// branch or a squash, refills it starting from the fetch address.
+class FetchBuffer {
+    const ProgramImage *_program = NULL;
+    std::vector<instruction> _buf;
+    size_t _base = 0;
+    size_t _count = 0;
+
+    public:
+    static const size_t DEFAULT_SIZE = 64;
+    void attach(const ProgramImage &program, size_t size = DEFAULT_SIZE) {
+        _program = &program;
+        _buf.resize(size);
+        _base = _count = 0;
+    }
+    // The instruction at program index pc, which must be in the program
+    const instruction& fetch(size_t pc) {
+        if (pc < _base || pc >= _base + _count) {
+            _base = pc;
+            _count = std::min(_buf.size(), _program->size() - pc);
+            for (size_t i = 0; i < _count; ++i)
+                _buf[i] = _program->decode(_base + i);
+        }
+        return _buf[pc - _base];
+    }
+};
@@ -0,0 +1,55 @@
+#include <vector>
+#include <algorithm>
+
+// Store set memory dependence predictor (Chrysos and Emer). Loads and stores found to
+// conflict are put in the same store set. A load waits for the last store of its set
+// fetched before it, if that store has not executed yet, and is otherwise free to go
+// ahead of older stores whose addresses are unknown.
+class StoreSetPredictor {
+    static const unsigned LFST_ENTRIES = 128;
+    static const unsigned long CLEAR_INTERVAL = 1ul << 15;  // loads between resets
+    std::vector<int> _ssit;                 // store set of each instruction, -1 if none
+    std::vector<unsigned long> _lfst;       // last fetched store of each set, 0 if none
+    unsigned long _loads = 0;
+
+    int& storeSet(unsigned pc) {
+        return _ssit[pc % _ssit.size()];
+    }
+
+    public:
+    void setSize(size_t ssit_entries) {
+        _ssit.assign(ssit_entries, -1);
+        _lfst.assign(LFST_ENTRIES, 0);
+        _loads = 0;
+    }
+    // The store a load fetched now should wait for, 0 if none. Sets only ever grow, so
+    // they are forgotten now and then.
+    unsigned long loadFetched(unsigned pc) {
+        if (++_loads % CLEAR_INTERVAL == 0)
+            setSize(_ssit.size());
+        int set = storeSet(pc);
+        return (set < 0) ? 0 : _lfst[set];
+    }
+    void storeFetched(unsigned pc, unsigned long seq) {
+        int set = storeSet(pc);
+        if (set >= 0)
+            _lfst[set] = seq;
+    }
+    void storeExecuted(unsigned pc, unsigned long seq) {
+        int set = storeSet(pc);
+        if (set >= 0 && _lfst[set] == seq)
+            _lfst[set] = 0;
+    }
+    // A load read its location before an older store wrote it: put them in one set
+    void violation(unsigned load_pc, unsigned store_pc) {
+        int &load_set = storeSet(load_pc), &store_set = storeSet(store_pc);
+        if (load_set < 0 && store_set < 0)
+            load_set = store_set = store_pc % LFST_ENTRIES;
+        else if (load_set < 0)
+            load_set = store_set;
+        else if (store_set < 0)
+            store_set = load_set;
+        else
+            load_set = store_set = std::min(load_set, store_set);
+    }
+};
@@ -0,0 +1,201 @@
+#include <cmath>
+
+// Synthetic programs for measuring the simulator and exploring the machine. A program
+// is a straight line of ALU operations, multiplies, divides, loads and stores drawn
+// with given weights. Each register operand depends on an earlier result at a
+// distance drawn from a distribution, and loads read the address of a recent store at
+// a given rate. Include program.hpp first.
+
+enum instruction_class {
+    CLASS_ALU, CLASS_MUL, CLASS_DIV, CLASS_LD, CLASS_ST,
+    INSTRUCTION_CLASSES
+};
+
+// Distance from a source operand back to the instruction producing it, counted in
+// instructions that write a register: 1 is the latest of them
+struct distance_distribution {
+    enum { FIXED, UNIFORM, GEOMETRIC } kind = GEOMETRIC;
+    unsigned min = 1, max = 1;  // the distance if fixed, else the range if uniform
+    double mean = 4;            // if geometric
+};
+
+struct synthetic_params {
+    unsigned long count = 100000;
+    unsigned mix[INSTRUCTION_CLASSES] = { 50, 10, 2, 25, 13 };
+    distance_distribution distance;
+    unsigned footprint = 1024;  // words of data memory touched
+    double alias_rate = 0.1;    // fraction of loads reading an address of a recent store
+    unsigned long long seed = 1;
+};
+
+// Parses the weights of the classes, "ALU:MUL:DIV:LD:ST". Returns false if invalid.
+bool parseMix(const std::string &text, synthetic_params &params) {
+    unsigned m[INSTRUCTION_CLASSES];
+    char end;
+    if (sscanf(text.c_str(), "%u:%u:%u:%u:%u%c", &m[0], &m[1], &m[2], &m[3], &m[4], &end) != 5)
+        return false;
+    if (m[0] + m[1] + m[2] + m[3] + m[4] == 0)
+        return false;
+    std::copy(m, m + INSTRUCTION_CLASSES, params.mix);
+    return true;
+}
+
+// Parses "fixed:N", "uniform:MIN:MAX" or "geometric:MEAN". Returns false if invalid.
+bool parseDistance(const std::string &text, distance_distribution &d) {
+    char end;
+    if (sscanf(text.c_str(), "fixed:%u%c", &d.min, &end) == 1 && d.min >= 1) {
+        d.kind = distance_distribution::FIXED;
+        d.max = d.min;
+        return true;
+    }
+    if (sscanf(text.c_str(), "uniform:%u:%u%c", &d.min, &d.max, &end) == 2
+            && d.min >= 1 && d.min <= d.max) {
+        d.kind = distance_distribution::UNIFORM;
+        return true;
+    }
+    if (sscanf(text.c_str(), "geometric:%lf%c", &d.mean, &end) == 1 && d.mean >= 1) {
+        d.kind = distance_distribution::GEOMETRIC;
+        return true;
+    }
+    return false;
+}
+
+class SyntheticGenerator {
+    static const unsigned RECENT_STORES = 16;   // stores an aliasing load may read after
+    const synthetic_params &_params;
+    unsigned long long _state;
+    unsigned long _producers = 0;               // instructions so far writing a register
+    std::vector<unsigned> _recent_stores;       // addresses, oldest overwritten first
+    unsigned long _stores = 0;
+
+    // xorshift64*, so that a seed gives the same program everywhere
+    unsigned long next() {
+        _state ^= _state >> 12;
+        _state ^= _state << 25;
+        _state ^= _state >> 27;
+        return (unsigned long)(_state * 2685821657736338717ULL);
+    }
+    double uniform() {
+        return (double)(next() >> 11) / (double)(1UL << 53);
+    }
+    unsigned distance() {
+        const distance_distribution &d = _params.distance;
+        switch (d.kind) {
+            case distance_distribution::FIXED:
+                return d.min;
+            case distance_distribution::UNIFORM:
+                return d.min + next() % (d.max - d.min + 1);
+            default:
+                // Number of trials up to the first success with probability 1/mean
+                if (d.mean <= 1)
+                    return 1;
+                return 1 + (unsigned)std::floor(std::log(1 - uniform()) / std::log(1 - 1/d.mean));
+        }
+    }
+    // Producers write the registers in turn, so the result of the one d back is still in
+    // its register for d up to ARF_SIZE. A longer distance, or one before the start,
+    // is no dependence and the operand is an immediate.
+    instruction::operand source() {
+        unsigned d = distance();
+        instruction::operand o;
+        o.is_imm = d > ARF_SIZE || d > _producers;
+        o.field = o.is_imm ? 1 + next() % 100 : (_producers - d) % ARF_SIZE;
+        return o;
+    }
+    int destination() {
+        return _producers++ % ARF_SIZE;
+    }
+    unsigned storeAddress() {
+        unsigned addr = next() % _params.footprint;
+        if (_recent_stores.size() < RECENT_STORES)
+            _recent_stores.push_back(addr);
+        else
+            _recent_stores[_stores % RECENT_STORES] = addr;
+        _stores++;
+        return addr;
+    }
+    // An address of a recent store at the alias rate, and otherwise one that none of
+    // them wrote, if a few tries find one
+    unsigned loadAddress() {
+        if (!_recent_stores.empty() && uniform() < _params.alias_rate)
+            return _recent_stores[next() % _recent_stores.size()];
+        unsigned addr = next() % _params.footprint;
+        for (int tries = 0; tries < 8; ++tries) {
+            if (std::find(_recent_stores.begin(), _recent_stores.end(), addr) == _recent_stores.end())
+                break;
+            addr = next() % _params.footprint;
+        }
+        return addr;
+    }
+    instruction_class pickClass() {
+        unsigned total = 0;
+        for (unsigned w : _params.mix)
+            total += w;
+        unsigned r = next() % total;
+        int c = 0;
+        while (r >= _params.mix[c])
+            r -= _params.mix[c++];
+        return (instruction_class)c;
+    }
+
+    public:
+    SyntheticGenerator(const synthetic_params &params)
+        : _params(params), _state(params.seed * 0x9E3779B97F4A7C15ULL + 1) {}
+
+    // The instruction at program index i. The sources are drawn before the
+    // destination, so that an instruction never depends on itself.
+    instruction generate(unsigned i) {
+        static const operation_type alu_ops[] = { ADD, SUB, AND, OR, XOR };
+        instruction instn;
+        instn.addr = i + 1;
+        instn.dest_arf_index = -1;
+        for (instruction::operand &o : instn.src) {
+            o.is_imm = true;
+            o.field = 0;
+        }
+        switch (pickClass()) {
+            case CLASS_ALU:
+                instn.op = alu_ops[next() % 5];
+                instn.src[0] = source();
+                instn.src[1] = source();
+                instn.dest_arf_index = destination();
+                break;
+            case CLASS_MUL:
+                instn.op = MUL;
+                instn.src[0] = source();
+                instn.src[1] = source();
+                instn.dest_arf_index = destination();
+                break;
+            case CLASS_DIV:
+                // A small constant divisor can neither be zero nor overflow
+                instn.op = DIV;
+                instn.src[0] = source();
+                instn.src[1].is_imm = true;
+                instn.src[1].field = 2 + next() % 8;
+                instn.dest_arf_index = destination();
+                break;
+            case CLASS_LD:
+                instn.op = LD;
+                instn.src[0].is_imm = true;
+                instn.src[0].field = loadAddress();
+                instn.dest_arf_index = destination();
+                break;
+            default:
+                instn.op = ST;
+                instn.src[0].is_imm = true;
+                instn.src[0].field = storeAddress();
+                instn.src[1] = source();
+                break;
+        }
+        return instn;
+    }
+};
+
+// A whole program with the given parameters
+void generateProgram(const synthetic_params &params, std::vector<instruction> &program) {
+    SyntheticGenerator generator(params);
+    program.clear();
+    program.reserve(params.count);
+    for (unsigned long i = 0; i < params.count; ++i)
+        program.push_back(generator.generate(i));
+}
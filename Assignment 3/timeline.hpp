@@ -0,0 +1,109 @@
+#include <array>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+// Timeline of each instruction through the pipeline: the cycles in which it was
+// fetched, dispatched, issued, finished executing, had its result written back on a
+// CDB, and committed or was squashed. The simulator writes one fixed-size record per
+// instruction to a binary trace, so the trace grows with the number of instructions
+// rather than with the number of cycles.
+
+enum pipeline_stage {
+    FETCH, DISPATCH, ISSUE, COMPLETE, WRITEBACK, RETIRE,
+    PIPELINE_STAGES
+};
+
+// Cycles of each stage, 0 for a stage the instruction never reached. Nothing happens
+// in cycle 0, which is the initial state.
+typedef std::array<unsigned long, PIPELINE_STAGES> stage_cycles;
+
+struct timeline_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+static const char TIMELINE_MAGIC[4] = { 'O', 'O', 'O', 'T' };
+static const uint32_t TIMELINE_VERSION = 1;
+static const uint32_t NO_CYCLE = 0xffffffff;
+
+// The stages after fetch are stored as cycles after the fetch cycle, NO_CYCLE if the
+// instruction never reached them. Records are in the order instructions left the
+// machine, by commit or squash.
+struct timeline_record {
+    uint64_t seq;
+    uint64_t fetch;
+    uint32_t pc;            // instruction address, counting from 1
+    uint8_t op;
+    uint8_t squashed;
+    uint16_t thread;        // hardware thread
+    uint32_t after_fetch[PIPELINE_STAGES-1];
+    uint32_t unused;
+};
+static_assert(sizeof(timeline_record) == 48, "timeline records are 48 bytes");
+
+// Writes the records through a buffer of a few thousand of them
+class TimelineWriter {
+    static const size_t BUFFER_RECORDS = 4096;
+    FILE *_file = NULL;
+    std::vector<timeline_record> _buffer;
+    unsigned long _records = 0;
+
+    TimelineWriter(const TimelineWriter&);
+    TimelineWriter& operator= (const TimelineWriter&);
+
+    void flush() {
+        if (!_buffer.empty())
+            fwrite(_buffer.data(), sizeof(timeline_record), _buffer.size(), _file);
+        _buffer.clear();
+    }
+
+    public:
+    TimelineWriter() {}
+    ~TimelineWriter() {
+        close();
+    }
+    // Returns false if the file cannot be created
+    bool open(const std::string &filename) {
+        _file = fopen(filename.c_str(), "wb");
+        if (!_file)
+            return false;
+        timeline_header header = {};
+        memcpy(header.magic, TIMELINE_MAGIC, sizeof(header.magic));
+        header.version = TIMELINE_VERSION;
+        header.record_size = sizeof(timeline_record);
+        fwrite(&header, sizeof(header), 1, _file);
+        _buffer.reserve(BUFFER_RECORDS);
+        return true;
+    }
+    void close() {
+        if (!_file)
+            return;
+        flush();
+        fclose(_file);
+        _file = NULL;
+    }
+    unsigned long recordCount() const {
+        return _records;
+    }
+    void write(unsigned long seq, int thread, unsigned pc, int op, bool squashed,
+            const stage_cycles &cycles) {
+        timeline_record r = {};
+        r.seq = seq;
+        r.fetch = cycles[FETCH];
+        r.thread = thread;
+        r.pc = pc;
+        r.op = op;
+        r.squashed = squashed;
+        for (int s = DISPATCH; s < PIPELINE_STAGES; ++s)
+            r.after_fetch[s-1] = cycles[s] ? cycles[s] - cycles[FETCH] : NO_CYCLE;
+        _buffer.push_back(r);
+        ++_records;
+        if (_buffer.size() == BUFFER_RECORDS)
+            flush();
+    }
+};